@@ -34,6 +34,12 @@ distribution.
 
 #ifdef USE_PATHER
 
+#if defined( __AVX2__ )
+#include <immintrin.h>
+#elif defined( __SSE2__ ) || defined( _M_X64 )
+#include <emmintrin.h>
+#endif
+
 #include "micropather.h"
 using namespace micropather;
 #endif
@@ -64,7 +70,7 @@ class Dungeon
 	void operator=( const Dungeon& );
   
 	int playerX, playerY;
-	MPVector<void*> path;
+	std::vector<void*> path;
 	bool doorsOpen;
 	bool showConsidered;
 
@@ -73,7 +79,7 @@ class Dungeon
   public:
 	Dungeon() : playerX( 0 ), playerY( 0 ), doorsOpen( false ), showConsidered( false ), pather( 0 )
 	{
-		pather = new MicroPather( this, 20 );	// Use a very small memory block to stress the pather
+		pather = new MicroPather( this, 20, 8, true );	// Use a very small memory block to stress the pather
 	}
 
 	virtual ~Dungeon() {
@@ -125,17 +131,17 @@ class Dungeon
 		if ( Passable( nx, ny ) == 1 )
 		{
 			#ifdef USE_PATHER
-				float totalCost;
 				if ( showConsidered )
 					pather->Reset();
 					
-				result = pather->Solve( XYToNode( playerX, playerY ), XYToNode( nx, ny ), &path, &totalCost );
+				path = pather->Solve( XYToNode( playerX, playerY ), XYToNode( nx, ny ) );
+				result = path.empty() ? 0 : 1;
 
-				if ( result == MicroPather::SOLVED ) {
+				if ( result ) {
 					playerX = nx;
 					playerY = ny;
 				}
-				printf( "Pather returned %d\n", result );
+				printf( "Pather returned %s\n", result ? "solved" : "no solution" );
 
 			#else
 				playerX = nx;
@@ -149,7 +155,7 @@ class Dungeon
 	{
 		char buf[ MAPX+1 ];
 
-		MPVector< void* > stateVec;
+		std::vector< void* > stateVec;
 		
 		if ( showConsidered )
 			pather->StatesInPool( &stateVec );
@@ -220,7 +226,62 @@ class Dungeon
 		return (float) sqrt( (double)(dx*dx) + (double)(dy*dy) );
 	}
 
-	virtual void AdjacentCost( void* node, micropather::MPVector< StateCost > *neighbors ) 
+	// Reference vectorized LeastCostEstimate(). The y*MAPX+x states are decoded in
+	// float, which is exact for small integers, then 8 (AVX2) or 4 (SSE2) distances
+	// are computed at a time. The remainder uses the scalar version.
+	virtual void LeastCostEstimateBatch( void* const* nodes, int n, void* nodeEnd, float* out )
+	{
+		int xEnd, yEnd;
+		NodeToXY( nodeEnd, &xEnd, &yEnd );
+		int i = 0;
+
+		#if defined( __AVX2__ )
+		const __m256 mapX8 = _mm256_set1_ps( (float)MAPX );
+		const __m256 invMapX8 = _mm256_set1_ps( 1.0f / (float)MAPX );
+		const __m256 half8 = _mm256_set1_ps( 0.5f );
+		const __m256 xEnd8 = _mm256_set1_ps( (float)xEnd );
+		const __m256 yEnd8 = _mm256_set1_ps( (float)yEnd );
+
+		for( ; i+8 <= n; i += 8 ) {
+			int index[8];
+			for( int k=0; k<8; ++k )
+				index[k] = (int)(intptr_t)nodes[i+k];
+
+			__m256 v = _mm256_cvtepi32_ps( _mm256_loadu_si256( (const __m256i*)index ) );
+			__m256 y = _mm256_cvtepi32_ps( _mm256_cvttps_epi32( _mm256_mul_ps( _mm256_add_ps( v, half8 ), invMapX8 ) ) );
+			__m256 x = _mm256_sub_ps( v, _mm256_mul_ps( y, mapX8 ) );
+			__m256 dx = _mm256_sub_ps( x, xEnd8 );
+			__m256 dy = _mm256_sub_ps( y, yEnd8 );
+			_mm256_storeu_ps( &out[i], _mm256_sqrt_ps( _mm256_add_ps( _mm256_mul_ps( dx, dx ), _mm256_mul_ps( dy, dy ) ) ) );
+		}
+		#endif
+
+		#if defined( __AVX2__ ) || defined( __SSE2__ ) || defined( _M_X64 )
+		const __m128 mapX4 = _mm_set1_ps( (float)MAPX );
+		const __m128 invMapX4 = _mm_set1_ps( 1.0f / (float)MAPX );
+		const __m128 half4 = _mm_set1_ps( 0.5f );
+		const __m128 xEnd4 = _mm_set1_ps( (float)xEnd );
+		const __m128 yEnd4 = _mm_set1_ps( (float)yEnd );
+
+		for( ; i+4 <= n; i += 4 ) {
+			int index[4];
+			for( int k=0; k<4; ++k )
+				index[k] = (int)(intptr_t)nodes[i+k];
+
+			__m128 v = _mm_cvtepi32_ps( _mm_loadu_si128( (const __m128i*)index ) );
+			__m128 y = _mm_cvtepi32_ps( _mm_cvttps_epi32( _mm_mul_ps( _mm_add_ps( v, half4 ), invMapX4 ) ) );
+			__m128 x = _mm_sub_ps( v, _mm_mul_ps( y, mapX4 ) );
+			__m128 dx = _mm_sub_ps( x, xEnd4 );
+			__m128 dy = _mm_sub_ps( y, yEnd4 );
+			_mm_storeu_ps( &out[i], _mm_sqrt_ps( _mm_add_ps( _mm_mul_ps( dx, dx ), _mm_mul_ps( dy, dy ) ) ) );
+		}
+		#endif
+
+		for( ; i<n; ++i )
+			out[i] = LeastCostEstimate( nodes[i], nodeEnd );
+	}
+
+	virtual void AdjacentCost( void* node, std::vector< StateCost > *neighbors ) 
 	{
 		int x, y;
 		const int dx[8] = { 1, 1, 0, -1, -1, -1, 0, 1 };
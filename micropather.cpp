@@ -29,11 +29,16 @@ distribution.
 #endif
 
 
+#include <algorithm>
 #include <stdexcept>
 
 #include <memory.h>
 #include <stdio.h>
 
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
 
 #include "micropather.h"
 
@@ -50,51 +55,209 @@ namespace
 			throw std::runtime_error("Assert failed");
 		}
 	}
+
+
+	// Read all of 'filename' into 'data', which is kept aligned for any Cost.
+	bool ReadFile(const char* filename, std::vector<uint64_t>* data, size_t* bytes)
+	{
+		FILE* fp = fopen(filename, "rb");
+		if (!fp)
+		{
+			return false;
+		}
+		bool ok = fseek(fp, 0, SEEK_END) == 0;
+		long size = ok ? ftell(fp) : -1;
+		ok = size >= 0 && fseek(fp, 0, SEEK_SET) == 0;
+		if (ok)
+		{
+			*bytes = static_cast<size_t>(size);
+			data->resize((*bytes + sizeof(uint64_t) - 1) / sizeof(uint64_t));
+			ok = fread(data->data(), 1, *bytes, fp) == *bytes;
+		}
+		fclose(fp);
+		return ok;
+	}
+
+
+	constexpr uint32_t PathCacheMagic = 0x4350504d;	// "MPPC" in little endian
+	constexpr uint16_t PathCacheVersion = 1;
+
+
+	// Sum of two costs, saturating at CostInfinity() so integer costs can't wrap.
+	template<typename Cost>
+	inline Cost AddCost(Cost a, Cost b)
+	{
+		return (a < CostInfinity<Cost>() - b) ? a + b : CostInfinity<Cost>();
+	}
+
+
+	// Index of the highest set bit, plus one. Zero for zero.
+	inline int BitWidth(uint32_t value)
+	{
+		if (value == 0)
+		{
+			return 0;
+		}
+#ifdef _MSC_VER
+		unsigned long index;
+		_BitScanReverse(&index, value);
+		return static_cast<int>(index) + 1;
+#else
+		return 32 - __builtin_clz(value);
+#endif
+	}
+
+
+	inline int BitWidth(uint64_t value)
+	{
+		uint32_t high = static_cast<uint32_t>(value >> 32);
+		return high ? 32 + BitWidth(high) : BitWidth(static_cast<uint32_t>(value));
+	}
+
+
+	// Non-negative IEEE floats order the same way as their bit patterns, so
+	// the radix heap can key on the bits directly. (Adding zero folds -0 to +0.)
+	inline uint32_t RadixKey(float cost)
+	{
+		cost += 0.0f;
+		uint32_t key;
+		memcpy(&key, &cost, sizeof(key));
+		return key;
+	}
+
+
+	inline uint64_t RadixKey(double cost)
+	{
+		cost += 0.0;
+		uint64_t key;
+		memcpy(&key, &cost, sizeof(key));
+		return key;
+	}
+
+
+	inline uint32_t RadixKey(uint32_t cost)
+	{
+		return cost;
+	}
 }
 
 
+template<typename Cost>
 class OpenQueue
 {
 public:
+	using PathNode = BasicPathNode<Cost>;
+	using Graph = BasicGraph<Cost>;
+
 	OpenQueue(const OpenQueue&) = delete;
 	void operator=(const OpenQueue&) = delete;
 
-	OpenQueue(Graph* _graph) :
+	OpenQueue(Graph* _graph, OpenList _type, TieBreak _tieBreak) :
 		sentinel{ nullptr },
-		sentinelMem{ 0 },
-		graph{ nullptr }
+		sentinelMem{},
+		graph{ nullptr },
+		type{ _type },
+		tieBreak{ _tieBreak }
 	{
 		graph = _graph;
-		sentinel = (PathNode*)sentinelMem;
+		sentinel = (PathNode*)sentinelMem.mem;
 		sentinel->InitSentinel();
+
+		if (type == OpenList::Radix)
+		{
+			for (int i = 0; i < NUM_BUCKETS; ++i)
+			{
+				bucket[i] = (PathNode*)bucketMem[i].mem;
+				bucket[i]->InitSentinel();
+			}
+		}
 	}
 
 	void Push(PathNode* pNode);
 	PathNode* Pop();
 	void Update(PathNode* pNode);
 
-	bool Empty() { return sentinel->next == sentinel; }
+	bool Empty() { return type == OpenList::Radix ? count == 0 : sentinel->next == sentinel; }
+
+	// Write up to 'max' nodes from the front of the queue (the ones most likely to be
+	// expanded next) to 'nodes'. Returns the number written.
+	int Front(PathNode** nodes, int max) const;
 
 private:
+	// Radix heap: bucket 0 holds keys equal to 'last' (the last key popped);
+	// bucket i holds keys whose highest bit differing from 'last' is bit i-1.
+	using Key = decltype(RadixKey(Cost()));
+	static const int NUM_BUCKETS = sizeof(Key) * 8 + 1;
+
+	// Raw storage for sentinels; PathNode has no default constructor.
+	struct alignas(PathNode) NodeMem
+	{
+		unsigned char mem[sizeof(PathNode)];
+	};
+
+	Key NodeKey(const PathNode* pNode) const
+	{
+		// Keys are monotone for a consistent heuristic. Clamp otherwise.
+		Key key = RadixKey(pNode->totalCost);
+		return key > last ? key : last;
+	}
+
+	int Bucket(Key key) const { return BitWidth(key ^ last); }
+	bool BucketEmpty(int i) const { return bucket[i]->next == bucket[i]; }
+
+	// True if 'a' should be popped before 'b'.
+	bool Before(const PathNode* a, const PathNode* b) const
+	{
+		if (a->totalCost != b->totalCost || tieBreak == TieBreak::Insertion)
+		{
+			return a->totalCost < b->totalCost;
+		}
+		if (a->costFromStart != b->costFromStart)
+		{
+			return a->costFromStart > b->costFromStart;
+		}
+		return (uintptr_t)a->state < (uintptr_t)b->state;
+	}
+
+	void PushRadix(PathNode* pNode);
+	PathNode* PopRadix();
+	void SortBucket(PathNode* head) const;
+	PathNode* MergeSort(PathNode* list) const;
 
 	PathNode* sentinel;
-	int sentinelMem[(sizeof(PathNode) + sizeof(int)) / sizeof(int)];
+	NodeMem sentinelMem;
 	Graph* graph;	// for debugging
+	OpenList type;
+	TieBreak tieBreak;
+
+	PathNode* bucket[NUM_BUCKETS];
+	NodeMem bucketMem[NUM_BUCKETS];
+	Key last{ 0 };
+	unsigned count{ 0 };
 };
 
 
-void OpenQueue::Push(PathNode* pNode)
+template<typename Cost>
+void OpenQueue<Cost>::Push(BasicPathNode<Cost>* pNode)
 {
 	assertExpression(pNode->inOpen == 0);
 	assertExpression(pNode->inClosed == 0);
+	assertExpression(pNode->totalCost < CostInfinity<Cost>());
+
+	if (type == OpenList::Radix)
+	{
+		PushRadix(pNode);
+		++count;
+		pNode->inOpen = 1;
+		return;
+	}
 
 	// Add sorted. Lowest to highest cost path. Note that the sentinel has
-	// a value of FLT_MAX, so it should always be sorted in.
-	assertExpression(pNode->totalCost < FLT_MAX);
+	// a value of CostInfinity(), so it should always be sorted in.
 	PathNode* iter = sentinel->next;
 	while (true)
 	{
-		if (pNode->totalCost < iter->totalCost)
+		if (Before(pNode, iter))
 		{
 			iter->AddBefore(pNode);
 			pNode->inOpen = 1;
@@ -108,11 +271,21 @@ void OpenQueue::Push(PathNode* pNode)
 }
 
 
-PathNode* OpenQueue::Pop()
+template<typename Cost>
+BasicPathNode<Cost>* OpenQueue<Cost>::Pop()
 {
-	assertExpression(sentinel->next != sentinel);
-	PathNode* pNode = sentinel->next;
-	pNode->Unlink();
+	PathNode* pNode = nullptr;
+	if (type == OpenList::Radix)
+	{
+		pNode = PopRadix();
+		--count;
+	}
+	else
+	{
+		assertExpression(sentinel->next != sentinel);
+		pNode = sentinel->next;
+		pNode->Unlink();
+	}
 
 	assertExpression(pNode->inClosed == 0);
 	assertExpression(pNode->inOpen == 1);
@@ -122,25 +295,34 @@ PathNode* OpenQueue::Pop()
 }
 
 
-void OpenQueue::Update(PathNode* pNode)
+template<typename Cost>
+void OpenQueue<Cost>::Update(BasicPathNode<Cost>* pNode)
 {
 	assertExpression(pNode->inOpen);
 
+	if (type == OpenList::Radix)
+	{
+		// Costs only go down, so the node moves to the same or a lower bucket.
+		pNode->Unlink();
+		PushRadix(pNode);
+		return;
+	}
+
 	// If the node now cost less than the one before it,
 	// move it to the front of the list.
-	if (pNode->prev != sentinel && pNode->totalCost < pNode->prev->totalCost)
+	if (pNode->prev != sentinel && Before(pNode, pNode->prev))
 	{
 		pNode->Unlink();
 		sentinel->next->AddBefore(pNode);
 	}
 
 	// If the node is too high, move to the right.
-	if (pNode->totalCost > pNode->next->totalCost)
+	if (Before(pNode->next, pNode))
 	{
 		PathNode* it = pNode->next;
 		pNode->Unlink();
 
-		while (pNode->totalCost > it->totalCost)
+		while (Before(it, pNode))
 		{
 			it = it->next;
 		}
@@ -150,9 +332,161 @@ void OpenQueue::Update(PathNode* pNode)
 }
 
 
+template<typename Cost>
+int OpenQueue<Cost>::Front(BasicPathNode<Cost>** nodes, int max) const
+{
+	int n = 0;
+	if (type == OpenList::Radix)
+	{
+		// Only bucket 0 is sorted, but the buckets are in increasing order.
+		for (int i = 0; i < NUM_BUCKETS && n < max; ++i)
+		{
+			for (PathNode* it = bucket[i]->next; it != bucket[i] && n < max; it = it->next)
+			{
+				nodes[n++] = it;
+			}
+		}
+	}
+	else
+	{
+		for (PathNode* it = sentinel->next; it != sentinel && n < max; it = it->next)
+		{
+			nodes[n++] = it;
+		}
+	}
+	return n;
+}
+
+
+template<typename Cost>
+void OpenQueue<Cost>::PushRadix(BasicPathNode<Cost>* pNode)
+{
+	PathNode* head = bucket[Bucket(NodeKey(pNode))];
+	if (head == bucket[0] && tieBreak == TieBreak::Deterministic)
+	{
+		// Keep bucket 0 in pop order. A child of the node just popped has the
+		// highest cost from start, so it usually goes straight to the front.
+		PathNode* it = head->next;
+		while (it != head && !Before(pNode, it))
+		{
+			it = it->next;
+		}
+		it->AddBefore(pNode);
+		return;
+	}
+
+	// Append, so equal keys pop first-in first-out like the sorted list.
+	head->AddBefore(pNode);
+}
+
+
+template<typename Cost>
+BasicPathNode<Cost>* OpenQueue<Cost>::PopRadix()
+{
+	assertExpression(count > 0);
+
+	if (BucketEmpty(0))
+	{
+		int i = 1;
+		while (BucketEmpty(i))
+		{
+			++i;
+		}
+
+		// The smallest key in the first non-empty bucket becomes 'last'. Every
+		// other node in that bucket then lands in a strictly lower bucket.
+		Key least = std::numeric_limits<Key>::max();
+		for (PathNode* it = bucket[i]->next; it != bucket[i]; it = it->next)
+		{
+			Key key = NodeKey(it);
+			least = key < least ? key : least;
+		}
+		last = least;
+
+		while (!BucketEmpty(i))
+		{
+			PathNode* pNode = bucket[i]->next;
+			pNode->Unlink();
+			bucket[Bucket(NodeKey(pNode))]->AddBefore(pNode);
+		}
+		if (tieBreak == TieBreak::Deterministic)
+		{
+			SortBucket(bucket[0]);
+		}
+	}
+
+	// Everything in bucket 0 has the same total cost, and with the deterministic
+	// tie break the bucket is in pop order.
+	PathNode* pNode = bucket[0]->next;
+	pNode->Unlink();
+	return pNode;
+}
+
+
+/**
+	Sort the list after the sentinel 'head' by Before(). A merge sort on the next
+	pointers, so it needs no memory; the prev pointers are fixed up after.
+*/
+template<typename Cost>
+void OpenQueue<Cost>::SortBucket(BasicPathNode<Cost>* head) const
+{
+	if (head->next == head || head->next->next == head)
+	{
+		return;
+	}
+	head->prev->next = nullptr;
+	head->next = MergeSort(head->next);
+
+	PathNode* prev = head;
+	for (PathNode* it = head->next; it; it = it->next)
+	{
+		it->prev = prev;
+		prev = it;
+	}
+	prev->next = head;
+	head->prev = prev;
+}
+
+
+template<typename Cost>
+BasicPathNode<Cost>* OpenQueue<Cost>::MergeSort(BasicPathNode<Cost>* list) const
+{
+	if (!list->next)
+	{
+		return list;
+	}
+
+	// Split after the middle node.
+	PathNode* middle = list;
+	for (PathNode* fast = list->next; fast && fast->next; fast = fast->next->next)
+	{
+		middle = middle->next;
+	}
+	PathNode* a = MergeSort(middle->next);
+	middle->next = nullptr;
+	PathNode* b = MergeSort(list);
+
+	PathNode* merged = nullptr;
+	PathNode** tail = &merged;
+	while (a && b)
+	{
+		PathNode** from = Before(a, b) ? &a : &b;
+		*tail = *from;
+		*from = (*from)->next;
+		tail = &(*tail)->next;
+	}
+	*tail = a ? a : b;
+	return merged;
+}
+
+
+template<typename Cost>
 class ClosedSet
 {
 public:
+	using PathNode = BasicPathNode<Cost>;
+	using Graph = BasicGraph<Cost>;
+
 	ClosedSet(const ClosedSet&) = delete;
 	void operator=(const ClosedSet&) = delete;
 
@@ -176,118 +510,235 @@ private:
 };
 
 
-PathNodePool::PathNodePool(unsigned _allocate, unsigned _typicalAdjacent) :
+template<typename Cost>
+BasicPathNodePool<Cost>::BasicPathNodePool(unsigned _allocate, unsigned _typicalAdjacent, std::pmr::memory_resource* _resource) :
+	resource(_resource),
 	firstBlock(0),
-	blocks(0),
+	currentBlock(0),
+	cacheChunks(_resource),
+	chunkOwners(_resource),
 	allocate(_allocate),
 	nAllocated(0),
-	nAvailable(0),
-	freeMemSentinel{ 0, 0, FLT_MAX, FLT_MAX, 0 }
+	nUsed(0)
 {
-	cacheCap = allocate * _typicalAdjacent;
+	defaultChunkSize = static_cast<int>(allocate * _typicalAdjacent);
+	defaultChunkSize = defaultChunkSize < MinChunkSize ? MinChunkSize : defaultChunkSize;
+	chunkSize = defaultChunkSize;
 	cacheSize = 0;
-	cache = (NodeCost*)malloc(cacheCap * sizeof(NodeCost));
+	cacheChunks.push_back(NewChunk());
+	chunkOwners.emplace_back();
 
 	// Want the behavior that if the actual number of states is specified, the cache 
 	// will be at least that big.
 	hashShift = 3;	// 8 (only useful for stress testing) 
-	hashTable = (PathNode**)calloc(HashSize(), sizeof(PathNode*));
+	while (HashSize() < allocate)
+	{
+		++hashShift;
+	}
+	hashTable = (PathNode**)resource->allocate(HashSize() * sizeof(PathNode*), alignof(PathNode*));
+	memset(hashTable, 0, HashSize() * sizeof(PathNode*));
 
-	blocks = firstBlock = NewBlock();
+	currentBlock = firstBlock = NewBlock();
 
 	totalCollide = 0;
 }
 
 
-PathNodePool::~PathNodePool()
+template<typename Cost>
+BasicPathNodePool<Cost>::~BasicPathNodePool()
 {
-	Clear();
-	free(firstBlock);
-	free(cache);
-	free(hashTable);
+	while (firstBlock)
+	{
+		Block* next = firstBlock->nextBlock;
+		resource->deallocate(firstBlock, BlockBytes(), alignof(Block));
+		firstBlock = next;
+	}
+	for (NodeCost* chunk : cacheChunks)
+	{
+		resource->deallocate(chunk, chunkSize * sizeof(NodeCost), alignof(NodeCost));
+	}
+	resource->deallocate(hashTable, HashSize() * sizeof(PathNode*), alignof(PathNode*));
 }
 
 
-bool PathNodePool::PushCache(const NodeCost* nodes, int nNodes, int* start)
+template<typename Cost>
+bool BasicPathNodePool<Cost>::PushCache(PathNode* owner, const NodeCost* nodes, int nNodes, int* start)
 {
 	*start = -1;
 
-	if (nNodes + cacheSize <= cacheCap)
+	if (nNodes > chunkSize)
+	{
+		return false;
+	}
+
+	// Skip the rest of the chunk if the list doesn't fit in it.
+	int offset = cacheSize % chunkSize;
+	if (offset + nNodes > chunkSize)
+	{
+		cacheSize += chunkSize - offset;
+		offset = 0;
+	}
+
+	size_t chunk = cacheSize / chunkSize;
+	if (offset == 0)
 	{
-		for (int i = 0; i < nNodes; ++i)
+		// Starting a chunk: add one, or at the budget go round to the oldest. Either
+		// way, evict whatever was in it.
+		if (chunk == cacheChunks.size())
 		{
-			cache[i + cacheSize] = nodes[i];
+			if (maxChunks && chunk >= maxChunks)
+			{
+				chunk = 0;
+				cacheSize = 0;
+			}
+			else
+			{
+				cacheChunks.push_back(NewChunk());
+				chunkOwners.emplace_back();
+			}
 		}
-		*start = cacheSize;
-		cacheSize += nNodes;
+		EvictChunk(chunk);
+	}
 
-		return true;
+	memcpy(cacheChunks[chunk] + offset, nodes, sizeof(NodeCost) * nNodes);
+	chunkOwners[chunk].push_back(owner);
+	*start = cacheSize;
+	cacheSize += nNodes;
+	return true;
+}
+
+
+template<typename Cost>
+void BasicPathNodePool<Cost>::EvictChunk(size_t chunk)
+{
+	// Forget the lists in the chunk. Their nodes still know how many neighbors they
+	// have, but ask the graph for them again. A node evicted before may have a list
+	// in another chunk by now.
+	for (PathNode* owner : chunkOwners[chunk])
+	{
+		if (owner->cacheIndex >= 0 && static_cast<size_t>(owner->cacheIndex / chunkSize) == chunk)
+		{
+			owner->cacheIndex = -1;
+			++cacheEvictions;
+		}
 	}
+	chunkOwners[chunk].clear();
+}
 
-	return false;
+
+template<typename Cost>
+void BasicPathNodePool<Cost>::ResetCache(int newChunkSize)
+{
+	for (size_t i = 0; i < cacheChunks.size(); ++i)
+	{
+		EvictChunk(i);
+		resource->deallocate(cacheChunks[i], chunkSize * sizeof(NodeCost), alignof(NodeCost));
+	}
+	cacheChunks.clear();
+	chunkOwners.clear();
+
+	chunkSize = newChunkSize;
+	cacheChunks.push_back(NewChunk());
+	chunkOwners.emplace_back();
+	cacheSize = 0;
+}
+
+
+template<typename Cost>
+void BasicPathNodePool<Cost>::SetCacheBudget(size_t bytes)
+{
+	// Aim for 8 chunks or more, so going round the ring evicts a small part of it.
+	size_t size = defaultChunkSize;
+	if (bytes > 0)
+	{
+		size_t entries = bytes / sizeof(NodeCost);
+		size = std::min(size, std::max<size_t>(entries / 8, MinChunkSize));
+	}
+	ResetCache(static_cast<int>(size));
+
+	size_t chunks = bytes / (chunkSize * sizeof(NodeCost));
+	maxChunks = bytes == 0 ? 0 : (chunks > 1 ? chunks : 1);
 }
 
 
-void PathNodePool::GetCache(int start, int nNodes, NodeCost* nodes)
+template<typename Cost>
+const typename BasicPathNodePool<Cost>::NodeCost* BasicPathNodePool<Cost>::GetCache(int start, int nNodes) const
 {
-	assertExpression(start >= 0 && start < cacheCap);
+	assertExpression(start >= 0 && static_cast<size_t>(start) < cacheChunks.size() * chunkSize);
 	assertExpression(nNodes > 0);
-	assertExpression(start + nNodes <= cacheCap);
-	memcpy(nodes, &cache[start], sizeof(NodeCost) * nNodes);
+	assertExpression(start % chunkSize + nNodes <= chunkSize);
+	return cacheChunks[start / chunkSize] + start % chunkSize;
 }
 
 
-void PathNodePool::Clear()
+template<typename Cost>
+void BasicPathNodePool<Cost>::Clear()
 {
-	Block* b = blocks;
+	// Keep the first retainBlocks blocks (we always need at least one) and free the rest.
+	Block* last = firstBlock;
+	for (uint32_t i = 1; i < retainBlocks && last->nextBlock; ++i)
+	{
+		last = last->nextBlock;
+	}
+	Block* b = last->nextBlock;
+	last->nextBlock = 0;
 	while (b)
 	{
 		Block* temp = b->nextBlock;
-		if (b != firstBlock)
-		{
-			free(b);
-		}
+		resource->deallocate(b, BlockBytes(), alignof(Block));
 		b = temp;
 	}
 
-	// Don't delete the first block (we always need at least that much memory.)
-	blocks = firstBlock;
+	peakAllocated = PeakAllocated();
 
 	// Set up for new allocations (but don't do work we don't need to. Reset/Clear can be called frequently.)
+	// The old nodes are unreachable once the hash table is empty; Alloc() hands them out again.
 	if (nAllocated > 0)
 	{
-		freeMemSentinel.next = &freeMemSentinel;
-		freeMemSentinel.prev = &freeMemSentinel;
-
 		memset(hashTable, 0, sizeof(PathNode*) * HashSize());
-		for (unsigned i = 0; i < allocate; ++i)
-		{
-			freeMemSentinel.AddBefore(&firstBlock->pathNode[i]);
-		}
 	}
-	nAvailable = allocate;
+	currentBlock = firstBlock;
+	nUsed = 0;
 	nAllocated = 0;
+
+	// Nothing in the neighbor cache is in use now; keep only its first chunk.
+	for (size_t i = 1; i < cacheChunks.size(); ++i)
+	{
+		resource->deallocate(cacheChunks[i], chunkSize * sizeof(NodeCost), alignof(NodeCost));
+	}
+	cacheChunks.resize(1);
+	chunkOwners.resize(1);
+	chunkOwners[0].clear();
 	cacheSize = 0;
 }
 
 
-PathNodePool::Block* PathNodePool::NewBlock()
+template<typename Cost>
+void BasicPathNodePool<Cost>::SetRetainBytes(size_t bytes)
 {
-	Block* block = (Block*)calloc(1, sizeof(Block) + sizeof(PathNode) * (allocate - 1));
-	block->nextBlock = 0;
+	size_t count = bytes / BlockBytes();
+	retainBlocks = count > 1 ? static_cast<uint32_t>(count) : 1;
+}
 
-	nAvailable += allocate;
 
-	for (unsigned i = 0; i < allocate; ++i)
-	{
-		freeMemSentinel.AddBefore(&block->pathNode[i]);
-	}
+template<typename Cost>
+typename BasicPathNodePool<Cost>::Block* BasicPathNodePool<Cost>::NewBlock()
+{
+	void* mem = resource->allocate(BlockBytes(), alignof(Block));
+	memset(mem, 0, BlockBytes());
+	return (Block*)mem;
+}
 
-	return block;
+
+template<typename Cost>
+typename BasicPathNodePool<Cost>::NodeCost* BasicPathNodePool<Cost>::NewChunk()
+{
+	return (NodeCost*)resource->allocate(chunkSize * sizeof(NodeCost), alignof(NodeCost));
 }
 
 
-uint32_t PathNodePool::Hash(void* voidval)
+template<typename Cost>
+uint32_t BasicPathNodePool<Cost>::Hash(void* voidval)
 {
 	uintptr_t h = (uintptr_t)(voidval);
 	return h % HashMask();
@@ -295,28 +746,32 @@ uint32_t PathNodePool::Hash(void* voidval)
 
 
 
-PathNode* PathNodePool::Alloc()
+template<typename Cost>
+BasicPathNode<Cost>* BasicPathNodePool<Cost>::Alloc()
 {
-	if (freeMemSentinel.next == &freeMemSentinel)
+	if (nUsed == allocate)
 	{
-		assertExpression(nAvailable == 0);
+		if (maxNodes && nAllocated + allocate > maxNodes)
+		{
+			return nullptr;
+		}
 
-		Block* b = NewBlock();
-		b->nextBlock = blocks;
-		blocks = b;
-		assertExpression(freeMemSentinel.next != &freeMemSentinel);
+		// Move on to the next block, reusing a retained one if there is one.
+		if (!currentBlock->nextBlock)
+		{
+			currentBlock->nextBlock = NewBlock();
+		}
+		currentBlock = currentBlock->nextBlock;
+		nUsed = 0;
 	}
-	PathNode* pathNode = freeMemSentinel.next;
-	pathNode->Unlink();
 
 	++nAllocated;
-	assertExpression(nAvailable > 0);
-	--nAvailable;
-	return pathNode;
+	return &currentBlock->pathNode[nUsed++];
 }
 
 
-void PathNodePool::AddPathNode(uint32_t key, PathNode* root)
+template<typename Cost>
+void BasicPathNodePool<Cost>::AddPathNode(uint32_t key, PathNode* root)
 {
 	if (hashTable[key])
 	{
@@ -342,7 +797,8 @@ void PathNodePool::AddPathNode(uint32_t key, PathNode* root)
 }
 
 
-PathNode* PathNodePool::FetchPathNode(void* state)
+template<typename Cost>
+BasicPathNode<Cost>* BasicPathNodePool<Cost>::FetchPathNode(void* state)
 {
 	unsigned key = Hash(state);
 
@@ -362,7 +818,8 @@ PathNode* PathNodePool::FetchPathNode(void* state)
 }
 
 
-PathNode* PathNodePool::GetPathNode(unsigned frame, void* _state, float _costFromStart, float _estToGoal, PathNode* _parent)
+template<typename Cost>
+BasicPathNode<Cost>* BasicPathNodePool<Cost>::GetPathNode(unsigned frame, void* _state, Cost _costFromStart, Cost _estToGoal, PathNode* _parent)
 {
 	unsigned key = Hash(_state);
 
@@ -383,6 +840,10 @@ PathNode* PathNodePool::GetPathNode(unsigned frame, void* _state, float _costFro
 	{
 		// allocate new one
 		root = Alloc();
+		if (!root)
+		{
+			return nullptr;
+		}
 		root->Clear();
 		root->Init(frame, _state, _costFromStart, _estToGoal, _parent);
 		AddPathNode(key, root);
@@ -392,10 +853,12 @@ PathNode* PathNodePool::GetPathNode(unsigned frame, void* _state, float _costFro
 }
 
 
-micropather::PathNode::PathNode(uint32_t _frame, void* _state, float _costFromStart, float _estToGoal, PathNode* _parent):
+template<typename Cost>
+BasicPathNode<Cost>::BasicPathNode(uint32_t _frame, void* _state, Cost _costFromStart, Cost _estToGoal, BasicPathNode* _parent):
 	state{ _state },
 	costFromStart{ _costFromStart },
 	estToGoal{ _estToGoal },
+	parentCost{ 0 },
 	parent{ _parent },
 	frame{ _frame },
 	inOpen{ 0 },
@@ -405,16 +868,18 @@ micropather::PathNode::PathNode(uint32_t _frame, void* _state, float _costFromSt
 }
 
 
-void PathNode::Init(unsigned _frame,
+template<typename Cost>
+void BasicPathNode<Cost>::Init(unsigned _frame,
 	void* _state,
-	float _costFromStart,
-	float _estToGoal,
-	PathNode* _parent)
+	Cost _costFromStart,
+	Cost _estToGoal,
+	BasicPathNode* _parent)
 {
 	state = _state;
 	costFromStart = _costFromStart;
 	estToGoal = _estToGoal;
 	CalcTotalCost();
+	parentCost = 0;
 	parent = _parent;
 	frame = _frame;
 	inOpen = 0;
@@ -422,23 +887,26 @@ void PathNode::Init(unsigned _frame,
 }
 
 
-void PathNode::Clear()
+template<typename Cost>
+void BasicPathNode<Cost>::Clear()
 {
-	memset( this, 0, sizeof( PathNode ) );
+	memset( this, 0, sizeof( BasicPathNode ) );
 	numAdjacent = -1;
 	cacheIndex  = -1;
 }
 
 
-void micropather::PathNode::InitSentinel()
+template<typename Cost>
+void BasicPathNode<Cost>::InitSentinel()
 {
 	Clear();
-	Init(0, 0, FLT_MAX, FLT_MAX, 0);
+	Init(0, 0, CostInfinity<Cost>(), CostInfinity<Cost>(), 0);
 	prev = next = this;
 }
 
 
-void micropather::PathNode::Unlink()
+template<typename Cost>
+void BasicPathNode<Cost>::Unlink()
 {
 	next->prev = prev;
 	prev->next = next;
@@ -446,7 +914,8 @@ void micropather::PathNode::Unlink()
 }
 
 
-void micropather::PathNode::AddBefore(PathNode* addThis)
+template<typename Cost>
+void BasicPathNode<Cost>::AddBefore(BasicPathNode* addThis)
 {
 	addThis->next = this;
 	addThis->prev = prev;
@@ -455,407 +924,1766 @@ void micropather::PathNode::AddBefore(PathNode* addThis)
 }
 
 
-void micropather::PathNode::CalcTotalCost()
+template<typename Cost>
+void BasicPathNode<Cost>::CalcTotalCost()
 {
-	if (costFromStart < FLT_MAX && estToGoal < FLT_MAX)
-	{
-		totalCost = costFromStart + estToGoal;
-	}
-	else
-	{
-		totalCost = FLT_MAX;
-	}
+	totalCost = AddCost(costFromStart, estToGoal);
 }
 
 
-MicroPather::MicroPather(Graph* _graph, unsigned allocate, unsigned typicalAdjacent, bool cache)
-	: pathNodePool(allocate, typicalAdjacent),
+template<typename Cost>
+BasicMicroPather<Cost>::BasicMicroPather(Graph* _graph, unsigned allocate, unsigned typicalAdjacent, bool cache, size_t cacheBytes, std::pmr::memory_resource* _resource)
+	: resource(_resource),
+	pathNodePool(allocate, typicalAdjacent, _resource),
 	graph(_graph),
 	frame(0)
 {
 	assertExpression(allocate);
 	assertExpression(typicalAdjacent);
 	pathCache = 0;
+	cacheItems = static_cast<int>(allocate * DefaultCacheStepsPerNode);
+	if (cacheBytes)
+	{
+		cacheItems = static_cast<int>(cacheBytes / sizeof(typename PathCache::Item));
+	}
 	if (cache)
 	{
-		pathCache = new PathCache(allocate * 4);	// untuned arbitrary constant	
+		std::pmr::polymorphic_allocator<PathCache> alloc(resource);
+		pathCache = alloc.allocate(1);
+		new (pathCache) PathCache(cacheItems, resource);
+		if (cacheBytes)
+		{
+			pathCache->SetBudget(cacheBytes, false);	// already this size; sets the budget
+		}
 	}
 }
 
 
-MicroPather::~MicroPather()
-{
-	delete pathCache;
-}
-
-
-void MicroPather::Reset()
+template<typename Cost>
+BasicMicroPather<Cost>::~BasicMicroPather()
 {
-	pathNodePool.Clear();
 	if (pathCache)
 	{
-		pathCache->Reset();
+		std::pmr::polymorphic_allocator<PathCache> alloc(resource);
+		pathCache->~PathCache();
+		alloc.deallocate(pathCache, 1);
 	}
-	frame = 0;
 }
 
 
-void MicroPather::GoalReached(PathNode* node, void* start, void* end, std::vector< void* >* _path)
+template<typename Cost>
+void BasicMicroPather<Cost>::SetPathCacheBudget(size_t bytes, bool autoResize)
 {
-	std::vector< void* >& path = *_path;
-	path.clear();
-
-	// We have reached the goal.
-	// How long is the path? Used to allocate the vector which is returned.
-	int count = 1;
-	PathNode* it = node;
-	while (it->parent)
+	std::pmr::polymorphic_allocator<PathCache> alloc(resource);
+	if (bytes == 0)
 	{
-		++count;
-		it = it->parent;
+		if (pathCache)
+		{
+			pathCache->~PathCache();
+			alloc.deallocate(pathCache, 1);
+			pathCache = 0;
+		}
+		return;
 	}
-
-	// Now that the path has a known length, allocate
-	// and fill the vector that will be returned.
-	if (count < 3)
+	if (!pathCache)
 	{
-		// Handle the short, special case.
-		path.resize(2);
-		path[0] = start;
-		path[1] = end;
+		pathCache = alloc.allocate(1);
+		new (pathCache) PathCache(cacheItems, resource);
 	}
-	else
-	{
-		path.resize(count);
+	pathCache->SetBudget(bytes, autoResize);
+}
 
-		path[0] = start;
-		path[count - 1] = end;
-		count -= 2;
-		it = node->parent;
 
-		while (it->parent)
-		{
-			path[count] = it->state;
-			it = it->parent;
-			--count;
-		}
-	}
+template<typename Cost>
+bool BasicMicroPather<Cost>::SavePathCache(const char* filename, StateIDMap* map) const
+{
+	return pathCache && pathCache->Save(filename, map);
+}
 
-	if (pathCache)
-	{
-		costVec.clear();
 
-		PathNode* pn0 = pathNodePool.FetchPathNode(path[0]);
-		PathNode* pn1 = 0;
-		for (unsigned i = 0; i < path.size() - 1; ++i)
-		{
-			pn1 = pathNodePool.FetchPathNode(path[i + 1]);
-			nodeCostVec.clear();
-			GetNodeNeighbors(pn0, &nodeCostVec);
-			for (unsigned j = 0; j < nodeCostVec.size(); ++j)
-			{
-				if (nodeCostVec[j].node == pn1)
-				{
-					costVec.push_back(nodeCostVec[j].cost);
-					break;
-				}
-			}
-			assertExpression(costVec.size() == i + 1);
-			pn0 = pn1;
+template<typename Cost>
+bool BasicMicroPather<Cost>::LoadPathCache(const void* image, size_t bytes, StateIDMap* map)
+{
+	return pathCache && pathCache->Load(image, bytes, map);
+}
+
+
+template<typename Cost>
+bool BasicMicroPather<Cost>::LoadPathCache(const char* filename, StateIDMap* map)
+{
+	return pathCache && pathCache->Load(filename, map);
+}
+
+
+template<typename Cost>
+void BasicMicroPather<Cost>::GetCacheData(CacheData* data) const
+{
+	*data = CacheData();
+	if (pathCache)
+	{
+		pathCache->GetData(data);
+	}
+}
+
+
+template<typename Cost>
+void BasicMicroPather<Cost>::Reset()
+{
+	pathNodePool.Clear();
+	if (pathCache)
+	{
+		pathCache->Reset();
+	}
+	frame = 0;
+	++estimateStamp;
+}
+
+
+template<typename Cost>
+template<typename Vec>
+Cost BasicMicroPather<Cost>::GoalReached(PathNode* node, void* start, void* end, Vec* _path)
+{
+	Vec& path = *_path;
+
+	// We have reached the goal.
+	// How long is the path? Used to allocate the vector which is returned.
+	int count = 1;
+	for (PathNode* it = node; it->parent; it = it->parent)
+	{
+		++count;
+	}
+
+	// Now that the path has a known length, fill the vector that will be returned,
+	// and the cost of each step for the path cache, in one walk back from the goal.
+	path.resize(count);
+	costVec.resize(count - 1);
+
+	PathNode* it = node;
+	for (int i = count - 1; i > 0; --i)
+	{
+		path[i] = it->state;
+		costVec[i - 1] = it->parentCost;
+		it = it->parent;
+	}
+	path[0] = start;
+
+	// If the search stopped short of the goal, at a state the path cache has a path
+	// from (see Search()), add the rest of the path, which SolvePath() has fetched.
+	Cost cost = node->costFromStart;
+	if (node->state != end)
+	{
+		for (size_t i = 0; i < spliceVec.size(); ++i)
+		{
+			path.push_back(spliceVec[i]);
+			costVec.push_back(spliceCostVec[i]);
+			cost = AddCost(cost, spliceCostVec[i]);
 		}
-		pathCache->Add(path, costVec);
 	}
+	assertExpression(path[path.size() - 1] == end);
+
+	if (HasCache())
+	{
+		CacheAdd(&path[0], &costVec[0], path.size());
+	}
+	return cost;
 }
 
 
-void MicroPather::GetNodeNeighbors(PathNode* node, std::vector< NodeCost >* pNodeCost)
+template<typename Cost>
+const typename BasicMicroPather<Cost>::NodeCost* BasicMicroPather<Cost>::GetNodeNeighbors(PathNode* node, PathNode* const* ahead, int nAhead)
 {
+	// Returns node->numAdjacent neighbors. A cached list is returned in place, so its
+	// nodes may be from a previous frame; the caller Refresh()es each one it uses.
 	if (node->numAdjacent == 0)
 	{
 		// it has no neighbors.
-		pNodeCost->resize(0);
+		++stats.neighborHits;
+		return nullptr;
 	}
 	else if (node->cacheIndex < 0)
 	{
 		// Not in the cache. Either the first time or just didn't fit. We don't know
 		// the number of neighbors and need to call back to the client.
-		stateCostVec.resize(0);
-		graph->AdjacentCost(node->state, &stateCostVec);
+		const StateCost* adjacent = nullptr;
+		int count = 0;
+		++stats.neighborMisses;
 
-		pNodeCost->resize(stateCostVec.size());
-		node->numAdjacent = static_cast<int>(stateCostVec.size());
-
-		if (node->numAdjacent > 0)
+		if (reversed)
 		{
-			// Now convert to pathNodes.
-			// Note that the microsoft std library is actually pretty slow.
-			// Move things to temp vars to help.
-			const unsigned stateCostVecSize = static_cast<unsigned int>(static_cast<int>(stateCostVec.size()));
-			const StateCost* stateCostVecPtr = &stateCostVec[0];
-			NodeCost* pNodeCostPtr = &(*pNodeCost)[0];
+			stateCostVec.resize(0);
+			reverseAdjacent = graph->ReverseAdjacentCost(node->state, &stateCostVec);
+			// If not implemented the graph is symmetric, and its lists serve both ways.
+			reversed = reverseAdjacent;
+		}
 
-			for (unsigned i = 0; i < stateCostVecSize; ++i)
+		if (reversed)
+		{
+			adjacent = stateCostVec.empty() ? nullptr : &stateCostVec[0];
+			count = static_cast<int>(stateCostVec.size());
+		}
+		else if (maxAdjacent > 0)
+		{
+			adjacentArray.resize(maxAdjacent);
+			adjacent = &adjacentArray[0];
+			count = graph->AdjacentCostArray(node->state, &adjacentArray[0]);
+			assertExpression(count <= maxAdjacent);
+		}
+		else
+		{
+			stateCostVec.resize(0);
+			if (nAhead == 0 || !BatchAdjacentCost(node, ahead, nAhead))
 			{
-				void* state = stateCostVecPtr[i].state;
-				pNodeCostPtr[i].cost = stateCostVecPtr[i].cost;
-				pNodeCostPtr[i].node = pathNodePool.GetPathNode(frame, state, FLT_MAX, FLT_MAX, 0);
+				graph->AdjacentCost(node->state, &stateCostVec);
 			}
+			adjacent = stateCostVec.empty() ? nullptr : &stateCostVec[0];
+			count = static_cast<int>(stateCostVec.size());
+		}
 
-			// Can this be cached?
-			int start = 0;
-			if (pNodeCost->size() > 0 && pathNodePool.PushCache(pNodeCostPtr, static_cast<int>(pNodeCost->size()), &start))
-			{
-				node->cacheIndex = start;
-			}
+		nodeCostVec.resize(count);
+		node->numAdjacent = count;
+
+		if (node->numAdjacent == 0)
+		{
+			return nullptr;
 		}
+		ConvertNeighbors(node, adjacent, node->numAdjacent, &nodeCostVec[0]);
+		return &nodeCostVec[0];
 	}
 	else
 	{
 		// In the cache!
-		pNodeCost->resize(node->numAdjacent);
-		NodeCost* pNodeCostPtr = &(*pNodeCost)[0];
-		pathNodePool.GetCache(node->cacheIndex, node->numAdjacent, pNodeCostPtr);
-
-		// A node is uninitialized (even if memory is allocated) if it is from a previous frame.
-		// Check for that, and Init() as necessary.
-		for (int i = 0; i < node->numAdjacent; ++i)
-		{
-			PathNode* pNode = pNodeCostPtr[i].node;
-			if (pNode->frame != frame)
-			{
-				pNode->Init(frame, pNode->state, FLT_MAX, FLT_MAX, 0);
-			}
-		}
+		++stats.neighborHits;
+		return pathNodePool.GetCache(node->cacheIndex, node->numAdjacent);
 	}
 }
 
 
-void PathNodePool::AllStates(uint32_t frame, std::vector< void* >* stateVec)
+template<typename Cost>
+void BasicMicroPather<Cost>::Refresh(PathNode* node)
 {
-	for (Block* b = blocks; b; b = b->nextBlock)
+	// A node is uninitialized (even if memory is allocated) if it is from a previous frame.
+	if (node->frame != frame)
 	{
-		for (uint32_t i = 0; i < allocate; ++i)
-		{
-			if (b->pathNode[i].frame == frame)
-			{
-				stateVec->push_back(b->pathNode[i].state);
-			}
-		}
+		node->Init(frame, node->state, CostInfinity<Cost>(), CostInfinity<Cost>(), 0);
 	}
 }
 
 
-PathCache::PathCache(int maxItems):
-	hit{ 0 },
-	miss{ 0 },
-	mMaxItems{ maxItems }
+template<typename Cost>
+bool BasicMicroPather<Cost>::BatchAdjacentCost(PathNode* node, PathNode* const* ahead, int nAhead)
 {
-	mItems.resize(mMaxItems);
-}
+	// Query 'node' and the nodes ahead of it in one call. The neighbors of 'node' are
+	// left in stateCostVec; the rest go straight to the neighbor cache.
+	batchStateVec.resize(0);
+	batchStateVec.push_back(node->state);
+	for (int i = 0; i < nAhead; ++i)
+	{
+		batchStateVec.push_back(ahead[i]->state);
+	}
+	batchCountVec.resize(batchStateVec.size());
 
+	if (!graph->AdjacentCostBatch(&batchStateVec[0], static_cast<int>(batchStateVec.size()), &stateCostVec, &batchCountVec[0]))
+	{
+		batchAdjacent = false;
+		stateCostVec.resize(0);
+		return false;
+	}
 
-PathCache::~PathCache()
-{}
+	int offset = batchCountVec[0];
+	for (int i = 0; i < nAhead; ++i)
+	{
+		int count = batchCountVec[i + 1];
+		ahead[i]->numAdjacent = count;
+		if (count > 0)
+		{
+			batchNodeCostVec.resize(count);
+			ConvertNeighbors(ahead[i], &stateCostVec[offset], count, &batchNodeCostVec[0]);
+		}
+		offset += count;
+	}
+	assertExpression(offset == static_cast<int>(stateCostVec.size()));
+
+	stateCostVec.resize(batchCountVec[0]);
+	return true;
+}
 
 
-void PathCache::Reset()
+template<typename Cost>
+bool BasicMicroPather<Cost>::IsGoal(void* state) const
 {
-	mItems.clear();
-	mItems.resize(mMaxItems);
-	hit = 0;
-	miss = 0;
+	if (goalCount == 1)
+	{
+		return state == goalStates[0];
+	}
+	return std::binary_search(goalVec.begin(), goalVec.end(), state);
 }
 
 
-void PathCache::Add(const std::vector<void*>& path, const std::vector<float>& cost)
+template<typename Cost>
+Cost BasicMicroPather<Cost>::Estimate(PathNode* node)
 {
-	if (mItems.size() + path.size() > mMaxItems)
+	if (node->estimateStamp == estimateStamp)
 	{
-		return;
+		++stats.estimatesSaved;
 	}
-
-	for (size_t i = 0; i < path.size() - 1; ++i)
+	else
 	{
-		void* end = path.back();
-		Item item = { path[i], end, path[i + 1], cost[i] };
-		AddItem(item);
+		node->estimate = goalCount == 1 ?
+			graph->LeastCostEstimate(node->state, goalStates[0]) :
+			graph->LeastCostEstimateToAny(node->state, goalStates, goalCount);
+		node->estimateStamp = estimateStamp;
+		++stats.estimates;
 	}
+	return node->estimate;
 }
 
 
-void PathCache::AddNoSolution(void* end, void* states[], int count)
+template<typename Cost>
+Cost BasicMicroPather<Cost>::Weighted(Cost estimate, float weight)
 {
-	if (count + mItems.size() > mMaxItems)
-	{
-		return;
-	}
-
-	for (int i = 0; i < count; ++i)
+	if (weight == 1.0f || estimate == CostInfinity<Cost>())
 	{
-		Item item = { states[i], end, 0, FLT_MAX };
-		AddItem(item);
+		return estimate;
 	}
+	double weighted = static_cast<double>(estimate) * weight;
+	return weighted < static_cast<double>(CostInfinity<Cost>()) ? static_cast<Cost>(weighted) : CostInfinity<Cost>();
 }
 
 
-std::vector<void*> PathCache::Solve(void* start, void* end)
+template<typename Cost>
+void BasicMicroPather<Cost>::EstimateNeighbors(PathNode* node, const NodeCost* neighbors, float weight)
 {
-	const Item* item = Find(start, end);
-	if (item)
+	// Set estToGoal for the newly reached neighbors of 'node' (in neither the open nor the
+	// closed set), inflated by 'weight'. Estimates already known for this goal are reused;
+	// the rest go to the graph in one batch. This is the first pass over the neighbors, so
+	// it also refreshes them.
+	estimateStateVec.resize(0);
+	estimateNodeVec.resize(0);
+	for (int i = 0; i < node->numAdjacent; ++i)
 	{
-		if (item->cost == FLT_MAX)
+		PathNode* child = neighbors[i].node;
+		Refresh(child);
+		if (child->inOpen || child->inClosed)
 		{
-			++hit;
-			return {};
+			continue;
 		}
 
-		std::vector<void*> path;
+		if (child->estimateStamp == estimateStamp)
+		{
+			child->estToGoal = Weighted(child->estimate, weight);
+			++stats.estimatesSaved;
+		}
+		else
+		{
+			estimateStateVec.push_back(child->state);
+			estimateNodeVec.push_back(child);
+		}
+	}
 
-		path.push_back(start);
+	if (!estimateStateVec.empty())
+	{
+		const int n = static_cast<int>(estimateStateVec.size());
+		estimateVec.resize(n);
+		if (goalCount == 1)
+		{
+			graph->LeastCostEstimateBatch(&estimateStateVec[0], n, goalStates[0], &estimateVec[0]);
+		}
+		else
+		{
+			for (int i = 0; i < n; ++i)
+			{
+				estimateVec[i] = graph->LeastCostEstimateToAny(estimateStateVec[i], goalStates, goalCount);
+			}
+		}
 
-		for (; start != end; start = item->next, item = Find(start, end))
+		for (int i = 0; i < n; ++i)
 		{
-			assertExpression(item);
-			path.push_back(item->next);
+			PathNode* child = estimateNodeVec[i];
+			child->estimate = estimateVec[i];
+			child->estimateStamp = estimateStamp;
+			child->estToGoal = Weighted(estimateVec[i], weight);
 		}
+		stats.estimates += n;
+	}
+}
 
-		++hit;
 
-		return path;
+template<typename Cost>
+void BasicMicroPather<Cost>::ConvertNeighbors(PathNode* node, const StateCost* adjacent, int count, NodeCost* nodeCost)
+{
+	// Now convert to pathNodes.
+	for (int i = 0; i < count; ++i)
+	{
+		nodeCost[i].cost = adjacent[i].cost;
+		nodeCost[i].node = pathNodePool.GetPathNode(frame, adjacent[i].state, CostInfinity<Cost>(), CostInfinity<Cost>(), 0);
+		if (!nodeCost[i].node)
+		{
+			// Out of nodes. The search stops, and the list isn't cached.
+			nodeLimitHit = true;
+			return;
+		}
 	}
 
-	++miss;
-
-	return {};
+	// Can this be cached?
+	int start = 0;
+	if (pathNodePool.PushCache(node, nodeCost, count, &start))
+	{
+		node->cacheIndex = start;
+	}
 }
 
 
-void PathCache::AddItem(const Item& item)
+template<typename Cost>
+void BasicPathNodePool<Cost>::AllStates(uint32_t frame, std::vector< void* >* stateVec)
 {
-	assertExpression(mMaxItems > 0);
-	uint32_t index = item.Hash() % mMaxItems;
-	while (true)
+	for (Block* b = firstBlock; b; b = b->nextBlock)
 	{
-		if (mItems[index].Empty())
+		// Nodes past nUsed in the current block, and later blocks, are not in use.
+		uint32_t count = (b == currentBlock) ? nUsed : allocate;
+		for (uint32_t i = 0; i < count; ++i)
 		{
-			mItems[index] = item;
-			break;
+			if (b->pathNode[i].frame == frame)
+			{
+				stateVec->push_back(b->pathNode[i].state);
+			}
 		}
-		else if (mItems[index].KeyEqual(item))
+		if (b == currentBlock)
 		{
-			assertExpression((mItems[index].next && item.next) || (mItems[index].next == 0 && item.next == 0));
-			// do nothing; in cache
 			break;
 		}
-
-		++index;
-		
-		if (index == static_cast<uint32_t>(mMaxItems))
-		{
-			index = 0;
-		}
 	}
 }
 
 
-const PathCache::Item* PathCache::Find(void* start, void* end)
+template<typename Cost>
+void BasicPathNodePool<Cost>::ClosedStates(uint32_t frame, std::pmr::vector< void* >* stateVec)
 {
-	assertExpression(mMaxItems > 0);
-	Item fake = { start, end, 0, 0 };
-	unsigned index = fake.Hash() % mMaxItems;
-	while (true)
+	for (Block* b = firstBlock; b; b = b->nextBlock)
 	{
-		if (mItems[index].Empty())
+		uint32_t count = (b == currentBlock) ? nUsed : allocate;
+		for (uint32_t i = 0; i < count; ++i)
 		{
-			return nullptr;
+			if (b->pathNode[i].frame == frame && b->pathNode[i].inClosed)
+			{
+				stateVec->push_back(b->pathNode[i].state);
+			}
 		}
-
-		if (mItems[index].KeyEqual(fake))
+		if (b == currentBlock)
 		{
-			return &mItems[index];
+			break;
 		}
+	}
+}
 
-		++index;
 
-		if (index == static_cast<unsigned int>(mMaxItems))
-		{
-			index = 0;
-		}
-	}
+template<typename Cost>
+BasicPathCache<Cost>::BasicPathCache(int maxItems, std::pmr::memory_resource* resource):
+	hit{ 0 },
+	miss{ 0 },
+	mItems{ resource },
+	mMaxItems{ maxItems }
+{
+	mItems.resize(mMaxItems);
 }
 
 
-std::vector<void*> MicroPather::Solve(void* startNode, void* endNode)
+template<typename Cost>
+BasicPathCache<Cost>::~BasicPathCache()
+{}
+
+
+template<typename Cost>
+void BasicPathCache<Cost>::Reset()
 {
-	std::vector<void*> path;
+	Clear();
+	hit = 0;
+	miss = 0;
+	partial = 0;
+}
 
-	if (startNode == endNode)
-	{
-		return {};
-	}
 
-	if (pathCache)
-	{
-		path = pathCache->Solve(startNode, endNode);
-		if (!path.empty())
-		{
-			return path;
-		}
-	}
+template<typename Cost>
+void BasicPathCache<Cost>::Clear()
+{
+	mItems.clear();
+	mItems.resize(mMaxItems);
+	mCount = 0;
+	mNoSolution = 0;
+	std::fill(std::begin(mEnds), std::end(mEnds), 0);
+}
 
-	++frame;
 
-	OpenQueue open(graph);
-	ClosedSet closed(graph);
+template<typename Cost>
+void BasicPathCache<Cost>::GetData(CacheData* data) const
+{
+	const int itemBytes = static_cast<int>(sizeof(Item));
+	data->nBytesAllocated = mMaxItems * itemBytes;
+	data->nBytesUsed = mCount * itemBytes;
+	data->memoryFraction = static_cast<float>(mCount) / static_cast<float>(mMaxItems);
+	data->hit = hit;
+	data->miss = miss;
+	data->hitFraction = hit + miss > 0 ? static_cast<float>(hit) / static_cast<float>(hit + miss) : 0.0f;
+}
+
 
-	PathNode* newPathNode = pathNodePool.GetPathNode(frame, startNode, 0, graph->LeastCostEstimate(startNode, endNode), 0);
+template<typename Cost>
+void BasicPathCache<Cost>::SetBudget(size_t bytes, bool autoResize)
+{
+	mMaxBytes = bytes;
+	mAutoResize = autoResize;
+	int budgetItems = static_cast<int>(bytes / sizeof(Item));
+	if (!autoResize || budgetItems < mMaxItems)
+	{
+		Resize(budgetItems);
+	}
+}
 
-	open.Push(newPathNode);
-	stateCostVec.resize(0);
-	nodeCostVec.resize(0);
 
-	while (!open.Empty())
+template<typename Cost>
+void BasicPathCache<Cost>::Resize(int maxItems)
+{
+	// Keep at least one empty slot, so a search of the table always ends.
+	maxItems = maxItems > 2 ? maxItems : 2;
+	if (maxItems == mMaxItems)
 	{
-		PathNode* node = open.Pop();
+		return;
+	}
+
+	std::pmr::vector<Item> old(mItems.get_allocator());
+	old.swap(mItems);
+	mMaxItems = maxItems;
+	mItems.resize(mMaxItems);
+	mCount = 0;
+	mNoSolution = 0;
+	std::fill(std::begin(mEnds), std::end(mEnds), 0);
 
-		if (node->state == endNode)
+	// Paths are whole or not at all: if the items don't fit, drop them.
+	int count = 0;
+	for (const Item& item : old)
+	{
+		count += item.Empty() ? 0 : 1;
+	}
+	if (count * 4 <= mMaxItems * 3)
+	{
+		for (const Item& item : old)
 		{
-			GoalReached(node, startNode, endNode, &path);
-			return path;
+			if (!item.Empty())
+			{
+				AddItem(item);
+			}
 		}
-		else
-		{
-			closed.Add(node);
+	}
+}
 
-			// We have not reached the goal - add the neighbors.
-			GetNodeNeighbors(node, &nodeCostVec);
 
-			for (int i = 0; i < node->numAdjacent; ++i)
-			{
-				// Not actually a neighbor, but useful. Filter out infinite cost.
-				if (nodeCostVec[i].cost == FLT_MAX)
-				{
-					continue;
-				}
+template<typename Cost>
+bool BasicPathCache<Cost>::MakeRoom(int needed)
+{
+	// Entries are kept to 3/4 of the table, so lookups stay short.
+	const bool fits = (mCount + needed) * 4 <= mMaxItems * 3;
+	if (fits || !mAutoResize)
+	{
+		return fits;
+	}
 
-				PathNode* child = nodeCostVec[i].node;
-				float newCost = node->costFromStart + nodeCostVec[i].cost;
+	// Too full. Grow if the budget allows and the cache is paying its way (or it's too
+	// soon to tell); otherwise empty it, so newer paths can get in. A search finished
+	// from a cached path counts as a hit.
+	const int lookups = hit + miss;
+	const bool earning = lookups < 64 || (hit + partial) * 8 >= lookups;
+	int grown = mMaxItems * 2;
+	while ((mCount + needed) * 4 > grown * 3)
+	{
+		grown *= 2;
+	}
+	if (earning && (mMaxBytes == 0 || grown * sizeof(Item) <= mMaxBytes))
+	{
+		Resize(grown);
+		return true;
+	}
 
-				PathNode* inOpen = child->inOpen ? child : 0;
-				PathNode* inClosed = child->inClosed ? child : 0;
-				PathNode* inEither = (PathNode*)(((uintptr_t)inOpen) | ((uintptr_t)inClosed));
+	Clear();
+	return needed * 4 <= mMaxItems * 3;
+}
 
-				assertExpression(inEither != node);
-				assertExpression(!(inOpen && inClosed));
 
-				if (inEither)
-				{
+template<typename Cost>
+void BasicPathCache<Cost>::Add(const std::vector<void*>& path, const std::vector<Cost>& cost)
+{
+	Add(&path[0], &cost[0], path.size());
+}
+
+
+template<typename Cost>
+void BasicPathCache<Cost>::Add(void* const* path, const Cost* cost, size_t count)
+{
+	if (!MakeRoom(static_cast<int>(count)))
+	{
+		return;
+	}
+
+	// Each item holds the cost of the rest of the path; add them from the start, so
+	// the path is found in order.
+	void* end = path[count - 1];
+	Cost remaining = 0;
+	for (size_t i = 0; i < count - 1; ++i)
+	{
+		remaining = AddCost(remaining, cost[i]);
+	}
+	for (size_t i = 0; i < count - 1; ++i)
+	{
+		Item item = { path[i], end, path[i + 1], remaining };
+		AddItem(item);
+		remaining = remaining > cost[i] ? remaining - cost[i] : 0;
+	}
+}
+
+
+template<typename Cost>
+void BasicPathCache<Cost>::AddNoSolution(void* end, void* states[], int count)
+{
+	// Each state stands alone, so add as many as fit. They count towards the 3/4 load
+	// like paths, but take at most a quarter of the table, and never grow or empty it:
+	// a failed search can close far more states than a path has, and mustn't push the
+	// paths out.
+	for (int i = 0; i < count && (mCount + 1) * 4 <= mMaxItems * 3 && (mNoSolution + 1) * 4 <= mMaxItems; ++i)
+	{
+		Item item = { states[i], end, 0, CostInfinity<Cost>() };
+		AddItem(item);
+	}
+}
+
+
+template<typename Cost>
+std::vector<void*> BasicPathCache<Cost>::Solve(void* start, void* end)
+{
+	std::vector<void*> path;
+	Fill(start, end, &path, nullptr);
+	return path;
+}
+
+
+template<typename Cost>
+bool BasicPathCache<Cost>::Solve(void* start, void* end, std::vector<void*>* path, Cost* totalCost)
+{
+	return Fill(start, end, path, totalCost);
+}
+
+
+template<typename Cost>
+bool BasicPathCache<Cost>::Solve(void* start, void* end, std::pmr::vector<void*>* path, Cost* totalCost)
+{
+	return Fill(start, end, path, totalCost);
+}
+
+
+template<typename Cost>
+bool BasicPathCache<Cost>::Solve(void* start, void* end, PathArena::Tail* path, Cost* totalCost)
+{
+	return Fill(start, end, path, totalCost);
+}
+
+
+template<typename Cost>
+template<typename Path>
+bool BasicPathCache<Cost>::Fill(void* start, void* end, Path* path, Cost* totalCost)
+{
+	path->clear();
+
+	const Item* item = Find(start, end);
+	if (item)
+	{
+		if (totalCost)
+		{
+			*totalCost = item->cost;
+		}
+		if (item->cost == CostInfinity<Cost>())
+		{
+			++hit;
+			return true;
+		}
+
+		path->push_back(start);
+
+		for (; start != end; start = item->next, item = Find(start, end))
+		{
+			// Steps cached from different searches could in principle lead in a
+			// circle (with zero cost steps, or a weighted search); treat that as a miss.
+			if (!item || static_cast<int>(path->size()) > mCount)
+			{
+				++miss;
+				path->clear();
+				return false;
+			}
+			path->push_back(item->next);
+		}
+
+		++hit;
+
+		return true;
+	}
+
+	++miss;
+
+	return false;
+}
+
+
+template<typename Cost>
+bool BasicPathCache<Cost>::Next(void* state, void* end, void** next, Cost* remaining)
+{
+	const Item* item = Find(state, end);
+	if (!item)
+	{
+		return false;
+	}
+	*next = item->next;
+	*remaining = item->cost;
+	return true;
+}
+
+
+template<typename Cost>
+bool BasicPathCache<Cost>::Follow(void* state, void* end, std::pmr::vector<void*>* states, std::pmr::vector<Cost>* steps)
+{
+	const size_t nStates = states->size();
+	const size_t nSteps = steps->size();
+
+	const Item* item = Find(state, end);
+	while (state != end)
+	{
+		if (!item || item->cost == CostInfinity<Cost>() || static_cast<int>(states->size() - nStates) > mCount)
+		{
+			states->resize(nStates);
+			steps->resize(nSteps);
+			return false;
+		}
+
+		// Each item has the cost of the rest of the path; the step is the difference.
+		void* next = item->next;
+		const Item* nextItem = next == end ? nullptr : Find(next, end);
+		Cost after = nextItem ? nextItem->cost : 0;
+		states->push_back(next);
+		steps->push_back(item->cost > after ? item->cost - after : 0);
+
+		state = next;
+		item = nextItem;
+	}
+	++partial;
+	return true;
+}
+
+
+template<typename Cost>
+bool BasicPathCache<Cost>::Save(const char* filename, StateIDMap* map) const
+{
+	FILE* fp = fopen(filename, "wb");
+	if (!fp)
+	{
+		return false;
+	}
+	bool ok = WriteHeader(fp, mCount) && WriteItems(fp, map);
+	return fclose(fp) == 0 && ok;
+}
+
+
+template<typename Cost>
+bool BasicPathCache<Cost>::Load(const void* image, size_t bytes, StateIDMap* map)
+{
+	int count = 0;
+	const FileItem* items = ReadImage(image, bytes, &count);
+	if (!items)
+	{
+		return false;
+	}
+	Clear();
+	Reserve(count);
+
+	// Paths first, so that if the table can't hold everything, it is the no-solution
+	// entries that are dropped.
+	for (int pass = 0; pass < 2; ++pass)
+	{
+		for (int i = 0; i < count; ++i)
+		{
+			if ((items[i].next != StateIDMap::NoStateID) == (pass == 0))
+			{
+				LoadItem(items[i], map);
+			}
+		}
+	}
+	return true;
+}
+
+
+template<typename Cost>
+bool BasicPathCache<Cost>::Load(const char* filename, StateIDMap* map)
+{
+	std::vector<uint64_t> data;
+	size_t bytes = 0;
+	return ReadFile(filename, &data, &bytes) && Load(data.data(), bytes, map);
+}
+
+
+template<typename Cost>
+bool BasicPathCache<Cost>::WriteHeader(FILE* fp, int count)
+{
+	FileHeader header = { PathCacheMagic, PathCacheVersion, sizeof(Cost), std::numeric_limits<Cost>::is_integer, sizeof(FileItem), static_cast<uint32_t>(count) };
+	return fwrite(&header, sizeof(header), 1, fp) == 1;
+}
+
+
+template<typename Cost>
+bool BasicPathCache<Cost>::WriteItems(FILE* fp, StateIDMap* map) const
+{
+	for (const Item& item : mItems)
+	{
+		if (!item.Empty())
+		{
+			// Zero the padding too (after 'next' when Cost is a double), so the file is
+			// the same for the same cache and holds nothing from the stack.
+			FileItem fileItem;
+			memset(&fileItem, 0, sizeof(fileItem));
+			fileItem.start = map->StateID(item.start);
+			fileItem.end = map->StateID(item.end);
+			fileItem.next = item.next ? map->StateID(item.next) : StateIDMap::NoStateID;
+			fileItem.cost = item.cost;
+			if (fwrite(&fileItem, sizeof(fileItem), 1, fp) != 1)
+			{
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+
+/**
+	The items of a saved cache, used in place, or null if 'image' isn't one for this
+	Cost type (or this byte order).
+*/
+template<typename Cost>
+const typename BasicPathCache<Cost>::FileItem* BasicPathCache<Cost>::ReadImage(const void* image, size_t bytes, int* count)
+{
+	static_assert(sizeof(FileHeader) % alignof(FileItem) == 0, "FileItems must stay aligned");
+
+	const FileHeader* header = static_cast<const FileHeader*>(image);
+	if (!image || bytes < sizeof(FileHeader) || reinterpret_cast<uintptr_t>(image) % alignof(FileItem) != 0
+		|| header->magic != PathCacheMagic || header->version != PathCacheVersion
+		|| header->costBytes != sizeof(Cost) || header->costIsInteger != std::numeric_limits<Cost>::is_integer
+		|| header->itemBytes != sizeof(FileItem) || header->count > static_cast<uint32_t>(std::numeric_limits<int>::max())
+		|| (bytes - sizeof(FileHeader)) / sizeof(FileItem) < header->count)
+	{
+		return nullptr;
+	}
+	*count = static_cast<int>(header->count);
+	return reinterpret_cast<const FileItem*>(static_cast<const char*>(image) + sizeof(FileHeader));
+}
+
+
+template<typename Cost>
+void BasicPathCache<Cost>::LoadItem(const FileItem& fileItem, StateIDMap* map)
+{
+	Item item = { map->IDState(fileItem.start), map->IDState(fileItem.end), nullptr, fileItem.cost };
+	if (fileItem.next != StateIDMap::NoStateID)
+	{
+		item.next = map->IDState(fileItem.next);
+		if (!item.next)
+		{
+			return;
+		}
+	}
+	// Stop at the 3/4 load, with no-solution entries held to a quarter of the table,
+	// as when adding. A dropped item only cuts short the paths through it; those
+	// become misses.
+	const bool fits = (mCount + 1) * 4 <= mMaxItems * 3 && (item.next || (mNoSolution + 1) * 4 <= mMaxItems);
+	if (item.start && item.end && fits)
+	{
+		AddItem(item);
+	}
+}
+
+
+/**
+	Grow the table, if the budget allows, to hold 'count' more items below 3/4 full.
+*/
+template<typename Cost>
+void BasicPathCache<Cost>::Reserve(int count)
+{
+	int wanted = (mCount + count) / 3 * 4 + 4;
+	if (wanted > mMaxItems && (mMaxBytes == 0 || static_cast<size_t>(wanted) * sizeof(Item) <= mMaxBytes))
+	{
+		Resize(wanted);
+	}
+}
+
+
+template<typename Cost>
+void BasicPathCache<Cost>::AddItem(const Item& item)
+{
+	assertExpression(mMaxItems > 0);
+	uint32_t index = item.Hash() % mMaxItems;
+	while (true)
+	{
+		if (mItems[index].Empty())
+		{
+			mItems[index] = item;
+			++mCount;
+			if (item.next)
+			{
+				mEnds[EndBit(item.end) / 64] |= uint64_t(1) << (EndBit(item.end) % 64);
+			}
+			else
+			{
+				++mNoSolution;
+			}
+			break;
+		}
+		else if (mItems[index].KeyEqual(item))
+		{
+			assertExpression((mItems[index].next && item.next) || (mItems[index].next == 0 && item.next == 0));
+			// do nothing; in cache
+			break;
+		}
+
+		++index;
+		
+		if (index == static_cast<uint32_t>(mMaxItems))
+		{
+			index = 0;
+		}
+	}
+}
+
+
+template<typename Cost>
+unsigned BasicPathCache<Cost>::EndBit(void* end)
+{
+	// Fibonacci hashing; the top 10 bits pick one of the 1024 bits in mEnds.
+	uint64_t hash = static_cast<uint64_t>(reinterpret_cast<uintptr_t>(end)) * 0x9E3779B97F4A7C15ull;
+	return static_cast<unsigned>(hash >> 54);
+}
+
+
+template<typename Cost>
+const typename BasicPathCache<Cost>::Item* BasicPathCache<Cost>::Find(void* start, void* end)
+{
+	assertExpression(mMaxItems > 0);
+	Item fake = { start, end, 0, 0 };
+	unsigned index = fake.Hash() % mMaxItems;
+	while (true)
+	{
+		if (mItems[index].Empty())
+		{
+			return nullptr;
+		}
+
+		if (mItems[index].KeyEqual(fake))
+		{
+			return &mItems[index];
+		}
+
+		++index;
+
+		if (index == static_cast<unsigned int>(mMaxItems))
+		{
+			index = 0;
+		}
+	}
+}
+
+
+template<typename Cost>
+std::vector<void*> BasicMicroPather<Cost>::Solve(void* startNode, void* endNode, Cost* totalCost)
+{
+	std::vector<void*> path;
+	Cost cost = SolvePath(startNode, endNode, &path);
+	if (totalCost)
+	{
+		*totalCost = cost;
+	}
+	return path;
+}
+
+
+template<typename Cost>
+SolveStatus BasicMicroPather<Cost>::Solve(void* startNode, void* endNode, Path* path, Cost* totalCost)
+{
+	Cost cost = SolvePath(startNode, endNode, path);
+	if (totalCost)
+	{
+		*totalCost = cost;
+	}
+	return status;
+}
+
+
+template<typename Cost>
+PathSpan BasicMicroPather<Cost>::SolveSpan(void* startNode, void* endNode, PathArena* arena, Cost* totalCost)
+{
+	if (!arena)
+	{
+		arena = &pathArena;
+	}
+	PathArena::Tail tail = arena->Append();
+	Cost cost = SolvePath(startNode, endNode, &tail);
+	if (totalCost)
+	{
+		*totalCost = cost;
+	}
+	return PathSpan(arena, tail.Start(), tail.size());
+}
+
+
+/**
+	Solve() into any kind of path. Returns the cost of the path, or CostInfinity().
+*/
+template<typename Cost>
+template<typename Vec>
+Cost BasicMicroPather<Cost>::SolvePath(void* startNode, void* endNode, Vec* path)
+{
+	path->clear();
+
+	if (startNode == endNode)
+	{
+		status = SolveStatus::StartEndSame;
+		return 0;
+	}
+
+	Cost cost = CostInfinity<Cost>();
+	if (HasCache() && CacheSolve(startNode, endNode, path, &cost))
+	{
+		if (path->empty())
+		{
+			status = SolveStatus::NoSolution;
+			++stats.failuresAvoided;
+		}
+		else
+		{
+			status = SolveStatus::Solved;
+		}
+		return cost;
+	}
+
+	PathNode* goal = Search(startNode, &endNode, 1, false, true, CacheMayHavePathsTo(endNode));
+	if (goal && goal->state != endNode && !CacheFollow(goal->state, endNode))
+	{
+		// The cached path has gone (from a cache shared with other pathers); search the
+		// whole way instead.
+		goal = Search(startNode, &endNode, 1);
+	}
+	if (goal)
+	{
+		return GoalReached(goal, startNode, endNode, path);
+	}
+	if (status != SolveStatus::NodeLimit)
+	{
+		NoSolution(startNode, &endNode, 1);
+	}
+	return CostInfinity<Cost>();
+}
+
+
+/**
+	Called when a search has run out of open nodes without reaching a goal. Every state
+	it closed is reachable from the start, so none of them can reach a goal either; the
+	path cache records them all (as many as fit), start first.
+*/
+template<typename Cost>
+void BasicMicroPather<Cost>::NoSolution(void* start, void* const* goals, int nGoals)
+{
+	status = SolveStatus::NoSolution;
+	if (HasCache())
+	{
+		closedVec.clear();
+		pathNodePool.ClosedStates(frame, &closedVec);
+		auto it = std::find(closedVec.begin(), closedVec.end(), start);
+		if (it != closedVec.end())
+		{
+			std::iter_swap(closedVec.begin(), it);
+		}
+		for (int i = 0; i < nGoals && !closedVec.empty(); ++i)
+		{
+			CacheAddNoSolution(goals[i], &closedVec[0], static_cast<int>(closedVec.size()));
+		}
+	}
+}
+
+
+template<typename Cost>
+bool BasicMicroPather<Cost>::CacheMayHavePathsTo(void* end) const
+{
+	if (sharedCache)
+	{
+		return sharedCache->MayHavePathsTo(end);
+	}
+	return pathCache && pathCache->MayHavePathsTo(end);
+}
+
+
+template<typename Cost>
+template<typename Vec>
+bool BasicMicroPather<Cost>::CacheSolve(void* start, void* end, Vec* path, Cost* totalCost)
+{
+	return sharedCache ? sharedCache->Solve(start, end, path, totalCost) : pathCache->Solve(start, end, path, totalCost);
+}
+
+
+template<typename Cost>
+bool BasicMicroPather<Cost>::CacheNext(void* state, void* end, void** next, Cost* remaining)
+{
+	return sharedCache ? sharedCache->Next(state, end, next, remaining) : pathCache->Next(state, end, next, remaining);
+}
+
+
+/**
+	Look up the nodes batched in spliceNodeVec in the shared cache, keeping the
+	cheapest path through any of them in 'spliceNode' and 'spliceCost'.
+*/
+template<typename Cost>
+void BasicMicroPather<Cost>::SpliceShared(void* end, PathNode** spliceNode, Cost* spliceCost)
+{
+	const int count = static_cast<int>(spliceNodeVec.size());
+	spliceStateVec.resize(count);
+	spliceRemainingVec.resize(count);
+	for (int i = 0; i < count; ++i)
+	{
+		spliceStateVec[i] = spliceNodeVec[i]->state;
+	}
+	sharedCache->Next(&spliceStateVec[0], count, end, &spliceRemainingVec[0]);
+
+	for (int i = 0; i < count; ++i)
+	{
+		Cost cost = AddCost(spliceNodeVec[i]->costFromStart, spliceRemainingVec[i]);
+		if (cost < *spliceCost)
+		{
+			*spliceNode = spliceNodeVec[i];
+			*spliceCost = cost;
+		}
+	}
+	spliceNodeVec.clear();
+}
+
+
+template<typename Cost>
+bool BasicMicroPather<Cost>::CacheFollow(void* state, void* end)
+{
+	spliceVec.clear();
+	spliceCostVec.clear();
+	return sharedCache ? sharedCache->Follow(state, end, &spliceVec, &spliceCostVec) : pathCache->Follow(state, end, &spliceVec, &spliceCostVec);
+}
+
+
+template<typename Cost>
+void BasicMicroPather<Cost>::CacheAdd(void* const* path, const Cost* cost, size_t count)
+{
+	if (sharedCache)
+	{
+		sharedCache->Add(path, cost, count, cacheEpoch);
+	}
+	else
+	{
+		pathCache->Add(path, cost, count);
+	}
+}
+
+
+template<typename Cost>
+void BasicMicroPather<Cost>::CacheAddNoSolution(void* end, void* states[], int count)
+{
+	if (sharedCache)
+	{
+		sharedCache->AddNoSolution(end, states, count, cacheEpoch);
+	}
+	else
+	{
+		pathCache->AddNoSolution(end, states, count);
+	}
+}
+
+
+template<typename Cost>
+std::vector<void*> BasicMicroPather<Cost>::SolveToAny(void* startState, const std::vector<void*>& goals, int* goalIndex)
+{
+	std::vector<void*> path;
+
+	auto it = std::find(goals.begin(), goals.end(), startState);
+	if (it != goals.end())
+	{
+		status = SolveStatus::StartEndSame;
+	}
+	else if (goals.empty())
+	{
+		status = SolveStatus::NoSolution;
+	}
+	else
+	{
+		PathNode* goal = Search(startState, &goals[0], static_cast<int>(goals.size()));
+		if (goal)
+		{
+			it = std::find(goals.begin(), goals.end(), goal->state);
+			GoalReached(goal, startState, goal->state, &path);
+		}
+		else if (status != SolveStatus::NodeLimit)
+		{
+			NoSolution(startState, &goals[0], static_cast<int>(goals.size()));
+		}
+	}
+
+	if (goalIndex)
+	{
+		*goalIndex = it == goals.end() ? -1 : static_cast<int>(it - goals.begin());
+	}
+	return path;
+}
+
+
+template<typename Cost>
+int BasicMicroPather<Cost>::SolveFromMany(const std::vector<void*>& startStates, void* endState,
+	std::vector< std::vector<void*> >* paths, std::vector<Cost>* costs)
+{
+	paths->resize(startStates.size());
+	if (costs)
+	{
+		costs->assign(startStates.size(), CostInfinity<Cost>());
+	}
+	if (startStates.empty())
+	{
+		status = SolveStatus::NoSolution;
+		return 0;
+	}
+
+	// Search from the goal towards the starts; each start's parents then lead to the goal.
+	searchReverse = true;
+	PathNode* last = Search(endState, &startStates[0], static_cast<int>(startStates.size()), true);
+	searchReverse = false;
+
+	int reached = 0;
+	for (size_t i = 0; i < startStates.size(); ++i)
+	{
+		std::vector<void*>& path = (*paths)[i];
+		path.clear();
+
+		PathNode* node = Settled(startStates[i], last);
+		if (!node)
+		{
+			continue;
+		}
+
+		++reached;
+		if (costs)
+		{
+			(*costs)[i] = node->costFromStart;
+		}
+		if (node->parent)
+		{
+			for (PathNode* it = node; it; it = it->parent)
+			{
+				path.push_back(it->state);
+			}
+		}
+	}
+
+	if (status != SolveStatus::NodeLimit && reached == 0)
+	{
+		status = SolveStatus::NoSolution;
+	}
+	return reached;
+}
+
+
+template<typename Cost>
+void BasicMicroPather<Cost>::SolveFlowField(void* goalState, BasicFlowField<Cost>* field)
+{
+	if (graph->BuildFlowField(goalState, field))
+	{
+		status = SolveStatus::Solved;
+		return;
+	}
+
+	// Dijkstra back from the goal; each state's parent is its next step towards it.
+	searchReverse = true;
+	SolveForNearStates(goalState, &flowVec, CostInfinity<Cost>());
+	searchReverse = false;
+
+	field->Init(goalState);
+	for (const StateCost& stateCost : flowVec)
+	{
+		PathNode* node = pathNodePool.FetchPathNode(stateCost.state);
+		field->Set(stateCost.state, node->parent ? node->parent->state : nullptr, stateCost.cost);
+	}
+	field->Finish();
+}
+
+
+template<typename Cost>
+void BasicMicroPather<Cost>::SolveDistances(void* startState, const std::vector<void*>& targets, Cost* costs)
+{
+	if (targets.empty())
+	{
+		status = SolveStatus::NoSolution;
+		return;
+	}
+
+	PathNode* last = Search(startState, &targets[0], static_cast<int>(targets.size()), true, false);
+	bool reached = false;
+	for (size_t i = 0; i < targets.size(); ++i)
+	{
+		PathNode* node = Settled(targets[i], last);
+		costs[i] = node ? node->costFromStart : CostInfinity<Cost>();
+		reached = reached || node;
+	}
+
+	if (status != SolveStatus::NodeLimit && !reached)
+	{
+		status = SolveStatus::NoSolution;
+	}
+}
+
+
+template<typename Cost>
+void BasicMicroPather<Cost>::SolveDistanceTable(Graph* graph, const std::vector<void*>& sources, const std::vector<void*>& targets,
+	Cost* table, unsigned threads, unsigned allocate, unsigned typicalAdjacent, std::pmr::memory_resource* resource)
+{
+	if (threads == 0)
+	{
+		threads = std::max(1u, std::thread::hardware_concurrency());
+	}
+	threads = std::min(threads, static_cast<unsigned>(sources.size()));
+
+	// Each thread takes the next unsolved source until there are none left.
+	std::atomic<size_t> next{ 0 };
+	auto work = [&]()
+	{
+		BasicMicroPather<Cost> pather(graph, allocate, typicalAdjacent, false, 0, resource);
+		for (size_t i = next++; i < sources.size(); i = next++)
+		{
+			pather.SolveDistances(sources[i], targets, table + i * targets.size());
+		}
+	};
+
+	std::vector<std::thread> pool;
+	for (unsigned i = 1; i < threads; ++i)
+	{
+		pool.emplace_back(work);
+	}
+	work();
+	for (std::thread& thread : pool)
+	{
+		thread.join();
+	}
+}
+
+
+/**
+	The node of 'state' if the last search settled it (popped it from the open list),
+	or null. 'last' is the node Search() returned, which is not in the closed set.
+*/
+template<typename Cost>
+BasicPathNode<Cost>* BasicMicroPather<Cost>::Settled(void* state, PathNode* last)
+{
+	PathNode* node = pathNodePool.GetPathNode(frame, state, CostInfinity<Cost>(), CostInfinity<Cost>(), 0);
+	return (node && (node->inClosed || node == last)) ? node : nullptr;
+}
+
+
+/**
+	Called when a search runs out of nodes. If the pool held nodes from earlier searches,
+	free them and return true to run the search again; otherwise the search fails.
+*/
+template<typename Cost>
+bool BasicMicroPather<Cost>::RetryAfterNodeLimit()
+{
+	if (poolAtStart > 0)
+	{
+		pathNodePool.Clear();
+		return true;
+	}
+
+	++stats.nodeLimitHits;
+	status = SolveStatus::NodeLimit;
+	return false;
+}
+
+
+template<typename Cost>
+PatherStats BasicMicroPather<Cost>::Stats() const
+{
+	PatherStats result = stats;
+	result.peakNodes = pathNodePool.PeakAllocated();
+	result.nodeLimit = pathNodePool.GetMaxNodes();
+	result.neighborEvictions = pathNodePool.CacheEvictions();
+	result.neighborCacheBytes = pathNodePool.CacheBytes();
+	return result;
+}
+
+
+template<typename Cost>
+std::vector<void*> BasicMicroPather<Cost>::SolveAnytime(void* startState, void* endState, float weight,
+	std::chrono::microseconds budget, float* bound)
+{
+	using Clock = std::chrono::steady_clock;
+	const Clock::time_point deadline = Clock::now() + budget;
+
+	std::vector<void*> path;
+	float pathBound = 0;
+
+	if (startState == endState)
+	{
+		status = SolveStatus::StartEndSame;
+		if (bound)
+		{
+			*bound = 1;
+		}
+		return path;
+	}
+
+	const float initialWeight = weight;
+	weight = weight < 1.0f ? 1.0f : weight;
+	BeginSearch(&endState, 1, false, true);
+
+	// Out of nodes before the first path: free old nodes and start over, or give up.
+	auto outOfNodes = [&]()
+	{
+		if (RetryAfterNodeLimit())
+		{
+			auto remaining = std::chrono::duration_cast<std::chrono::microseconds>(deadline - Clock::now());
+			return SolveAnytime(startState, endState, initialWeight, remaining, bound);
+		}
+		if (bound)
+		{
+			*bound = 0;
+		}
+		return std::vector<void*>();
+	};
+
+	// The frame, and so every node's cost and parent, is kept across iterations; each
+	// one only re-expands the nodes whose cost improved since they were closed.
+	PathNode* goal = pathNodePool.GetPathNode(frame, endState, CostInfinity<Cost>(), 0, 0);
+	PathNode* start = pathNodePool.GetPathNode(frame, startState, 0, CostInfinity<Cost>(), 0);
+	if (!goal || !start)
+	{
+		return outOfNodes();
+	}
+	Estimate(start);
+
+	anytimeOpenVec.assign(1, start);
+
+	while (true)
+	{
+		anytimeClosedVec.clear();
+		anytimeInconsVec.clear();
+
+		// Re-key the open nodes for this iteration's weight.
+		OpenQueue<Cost> open(graph, OpenList::Sorted, tieBreak);
+		for (PathNode* node : anytimeOpenVec)
+		{
+			node->estToGoal = Weighted(node->estimate, weight);
+			node->CalcTotalCost();
+			open.Push(node);
+		}
+
+		// Expand until no open node could lead to a cheaper path to the goal.
+		bool expired = false;
+		for (unsigned expansions = 1; !open.Empty(); ++expansions)
+		{
+			PathNode* front = nullptr;
+			open.Front(&front, 1);
+			if (front->totalCost >= goal->costFromStart)
+			{
+				break;
+			}
+			if (!path.empty() && (expansions & 255) == 0 && Clock::now() > deadline)
+			{
+				expired = true;
+				break;
+			}
+
+			PathNode* node = open.Pop();
+			node->inClosed = 1;
+			anytimeClosedVec.push_back(node);
+
+			const NodeCost* neighbors = GetNodeNeighbors(node);
+			if (nodeLimitHit)
+			{
+				// Keep the path already found, if any; its bound still holds.
+				if (path.empty())
+				{
+					return outOfNodes();
+				}
+				expired = true;
+				break;
+			}
+			EstimateNeighbors(node, neighbors, weight);
+
+			for (int i = 0; i < node->numAdjacent; ++i)
+			{
+				Cost newCost = AddCost(node->costFromStart, neighbors[i].cost);
+				PathNode* child = neighbors[i].node;
+				if (newCost == CostInfinity<Cost>() || !(newCost < child->costFromStart))
+				{
+					continue;
+				}
+
+				child->parent = node;
+				child->costFromStart = newCost;
+				child->parentCost = neighbors[i].cost;
+				if (child->inClosed)
+				{
+					// Closed for this weight; its new cost is picked up by the next iteration.
+					anytimeInconsVec.push_back(child);
+					continue;
+				}
+
+				child->estToGoal = Weighted(child->estimate, weight);
+				child->CalcTotalCost();
+				if (child->inOpen)
+				{
+					open.Update(child);
+				}
+				else
+				{
+					open.Push(child);
+				}
+			}
+		}
+
+		if (!expired && goal->costFromStart != CostInfinity<Cost>())
+		{
+			path.clear();
+			for (PathNode* it = goal; it; it = it->parent)
+			{
+				path.push_back(it->state);
+			}
+			std::reverse(path.begin(), path.end());
+			pathBound = weight;
+		}
+
+		if (expired || path.empty() || weight == 1.0f || Clock::now() > deadline)
+		{
+			break;
+		}
+
+		// Halve the excess weight, snapping to 1 once it is small.
+		weight = 1.0f + (weight - 1.0f) * 0.5f;
+		if (weight < 1.05f)
+		{
+			weight = 1.0f;
+		}
+
+		// The next iteration starts from the open nodes plus the improved closed ones.
+		anytimeOpenVec.clear();
+		for (PathNode* node : anytimeInconsVec)
+		{
+			if (node->inClosed)
+			{
+				node->inClosed = 0;
+				anytimeOpenVec.push_back(node);
+			}
+		}
+		for (PathNode* node : anytimeClosedVec)
+		{
+			node->inClosed = 0;
+		}
+		while (!open.Empty())
+		{
+			anytimeOpenVec.push_back(open.Pop());
+		}
+	}
+
+	if (path.empty())
+	{
+		status = SolveStatus::NoSolution;
+	}
+	if (bound)
+	{
+		*bound = pathBound;
+	}
+	return path;
+}
+
+
+/**
+	Start a new frame and set the goals of a search. Returns the number of goals to
+	pop before it is done: one, or all the distinct goals if 'reachAll' is set.
+*/
+template<typename Cost>
+int BasicMicroPather<Cost>::BeginSearch(void* const* goals, int nGoals, bool reachAll, bool useEstimate)
+{
+	// The pool's neighbor lists are for one direction; switching starts it afresh.
+	// Symmetric graphs use AdjacentCost() both ways, so never switch.
+	if ((searchReverse && reverseAdjacent) != reversed)
+	{
+		pathNodePool.Clear();
+		reversed = !reversed;
+	}
+
+	++frame;
+	maxAdjacent = graph->MaxAdjacent();
+
+	status = SolveStatus::Solved;
+	nodeLimitHit = false;
+	poolAtStart = pathNodePool.Allocated();
+	cacheEpoch = sharedCache ? sharedCache->Epoch() : 0;
+
+	goalStates = goals;
+	goalCount = nGoals;
+	int goalsLeft = 1;
+	if (nGoals > 1)
+	{
+		goalVec.assign(goals, goals + nGoals);
+		std::sort(goalVec.begin(), goalVec.end());
+		goalVec.erase(std::unique(goalVec.begin(), goalVec.end()), goalVec.end());
+		if (reachAll)
+		{
+			goalsLeft = static_cast<int>(goalVec.size());
+		}
+	}
+
+	// Estimates to a single goal may be kept from an earlier search; estimates to
+	// several goals are always recomputed.
+	if (useEstimate && (!retainEstimates || nGoals != 1 || !estimateGoalSet || goals[0] != estimateGoal))
+	{
+		++estimateStamp;
+		estimateGoal = goals[0];
+		estimateGoalSet = nGoals == 1;
+	}
+
+	return goalsLeft;
+}
+
+
+/**
+	A* from 'startNode' until any of the nGoals goal states is popped from the open list,
+	or all of them if 'reachAll' is set. Without 'useEstimate' it is a Dijkstra search.
+	Returns the goal popped last, with the path back to the start in its parents, or null
+	if the open list ran out first.
+
+	With 'splice' (a single goal only) states the path cache has a path from aren't
+	expanded. The search can then return such a state instead of the goal, once nothing
+	open could lead to a cheaper path than the one through it.
+*/
+template<typename Cost>
+BasicPathNode<Cost>* BasicMicroPather<Cost>::Search(void* startNode, void* const* goals, int nGoals, bool reachAll, bool useEstimate, bool splice)
+{
+	int goalsLeft = BeginSearch(goals, nGoals, reachAll, useEstimate);
+
+	OpenQueue<Cost> open(graph, openList, tieBreak);
+	ClosedSet<Cost> closed(graph);
+
+	PathNode* newPathNode = pathNodePool.GetPathNode(frame, startNode, 0, CostInfinity<Cost>(), 0);
+	if (!newPathNode)
+	{
+		return RetryAfterNodeLimit() ? Search(startNode, goals, nGoals, reachAll, useEstimate, splice) : nullptr;
+	}
+	newPathNode->estToGoal = useEstimate ? Weighted(Estimate(newPathNode), heuristicWeight) : 0;
+	newPathNode->CalcTotalCost();
+
+	open.Push(newPathNode);
+	stateCostVec.resize(0);
+
+	// The best node found so far with a cached path to the goal, and the cost through it.
+	PathNode* spliceNode = nullptr;
+	Cost spliceCost = CostInfinity<Cost>();
+	spliceNodeVec.clear();
+
+	while (!open.Empty())
+	{
+		PathNode* node = open.Pop();
+
+		if (spliceNode && !(node->totalCost < spliceCost))
+		{
+			// Nothing left open can beat the path through the cached one.
+			return spliceNode;
+		}
+
+		if (IsGoal(node->state) && --goalsLeft == 0)
+		{
+			return node;
+		}
+		else
+		{
+			closed.Add(node);
+
+			void* next = nullptr;
+			Cost remaining = 0;
+			if (splice && sharedCache)
+			{
+				// A shared cache takes a lock per call, so ask it about several nodes at
+				// once. They are expanded meanwhile, which costs time but not the best path.
+				spliceNodeVec.push_back(node);
+				if (spliceNodeVec.size() == SpliceBatch)
+				{
+					SpliceShared(goals[0], &spliceNode, &spliceCost);
+				}
+			}
+			else if (splice && CacheNext(node->state, goals[0], &next, &remaining))
+			{
+				// Every path to the goal from here costs at least the cached one (or
+				// there is none), so there's no need to expand the node.
+				Cost cost = AddCost(node->costFromStart, remaining);
+				if (cost < spliceCost)
+				{
+					spliceNode = node;
+					spliceCost = cost;
+				}
+				continue;
+			}
+
+			// We have not reached the goal - add the neighbors. If the graph batches
+			// adjacency queries, include the unknown nodes about to be expanded.
+			int nAhead = 0;
+			if (batchAdjacent && maxAdjacent == 0 && lookahead > 0 && node->numAdjacent < 0)
+			{
+				aheadVec.resize(lookahead);
+				int nFront = open.Front(&aheadVec[0], static_cast<int>(lookahead));
+				for (int i = 0; i < nFront; ++i)
+				{
+					if (aheadVec[i]->numAdjacent < 0)
+					{
+						aheadVec[nAhead++] = aheadVec[i];
+					}
+				}
+			}
+			const NodeCost* neighbors = GetNodeNeighbors(node, nAhead > 0 ? &aheadVec[0] : nullptr, nAhead);
+			if (nodeLimitHit)
+			{
+				return RetryAfterNodeLimit() ? Search(startNode, goals, nGoals, reachAll, useEstimate, splice) : nullptr;
+			}
+
+			if (useEstimate)
+			{
+				EstimateNeighbors(node, neighbors, heuristicWeight);
+			}
+
+			for (int i = 0; i < node->numAdjacent; ++i)
+			{
+				// Not actually a neighbor, but useful. Filter out infinite cost.
+				Cost newCost = AddCost(node->costFromStart, neighbors[i].cost);
+				if (newCost == CostInfinity<Cost>())
+				{
+					continue;
+				}
+
+				PathNode* child = neighbors[i].node;
+				Refresh(child);
+
+				PathNode* inOpen = child->inOpen ? child : 0;
+				PathNode* inClosed = child->inClosed ? child : 0;
+				PathNode* inEither = (PathNode*)(((uintptr_t)inOpen) | ((uintptr_t)inClosed));
+
+				assertExpression(inEither != node);
+				assertExpression(!(inOpen && inClosed));
+
+				if (inEither)
+				{
 					if (newCost < child->costFromStart)
 					{
+						// The estimate doesn't depend on the route; keep it.
 						child->parent = node;
 						child->costFromStart = newCost;
-						child->estToGoal = graph->LeastCostEstimate(child->state, endNode);
+						child->parentCost = neighbors[i].cost;
 						child->CalcTotalCost();
+						++stats.estimatesSaved;
 						if (inOpen)
 						{
 							open.Update(child);
@@ -863,23 +2691,673 @@ std::vector<void*> MicroPather::Solve(void* startNode, void* endNode)
 					}
 				}
 				else
+				{
+					// estToGoal was filled in by EstimateNeighbors().
+					if (!useEstimate)
+					{
+						child->estToGoal = 0;
+					}
+					child->parent = node;
+					child->costFromStart = newCost;
+					child->parentCost = neighbors[i].cost;
+					child->CalcTotalCost();
+
+					assertExpression(!child->inOpen && !child->inClosed);
+					open.Push(child);
+				}
+			}
+		}
+	}
+
+	if (!spliceNodeVec.empty())
+	{
+		SpliceShared(goals[0], &spliceNode, &spliceCost);
+	}
+	return spliceNode;
+}
+
+
+
+template<typename Cost>
+void BasicMicroPather<Cost>::SolveForNearStates(void* startState, std::vector< StateCost >* near, Cost maxCost)
+{
+	near->clear();
+
+	BeginSearch(&startState, 1, false, false);
+
+	OpenQueue<Cost> open(graph, openList, tieBreak);
+	ClosedSet<Cost> closed(graph);
+
+	// With no estimate, the total cost is the cost from start.
+	PathNode* startNode = pathNodePool.GetPathNode(frame, startState, 0, 0, 0);
+	if (!startNode)
+	{
+		if (RetryAfterNodeLimit())
+		{
+			SolveForNearStates(startState, near, maxCost);
+		}
+		return;
+	}
+	open.Push(startNode);
+
+	while (!open.Empty())
+	{
+		PathNode* node = open.Pop();
+		closed.Add(node);
+
+		StateCost stateCost = { node->state, node->costFromStart };
+		near->push_back(stateCost);
+
+		const NodeCost* neighbors = GetNodeNeighbors(node);
+		if (nodeLimitHit)
+		{
+			if (RetryAfterNodeLimit())
+			{
+				SolveForNearStates(startState, near, maxCost);
+			}
+			return;
+		}
+
+		for (int i = 0; i < node->numAdjacent; ++i)
+		{
+			PathNode* child = neighbors[i].node;
+			Refresh(child);
+			Cost newCost = AddCost(node->costFromStart, neighbors[i].cost);
+
+			// Closed nodes already have their final cost.
+			if (newCost > maxCost || newCost == CostInfinity<Cost>() || child->inClosed)
+			{
+				continue;
+			}
+
+			if (child->inOpen)
+			{
+				if (newCost < child->costFromStart)
 				{
 					child->parent = node;
 					child->costFromStart = newCost;
-					child->estToGoal = graph->LeastCostEstimate(child->state, endNode),
-						child->CalcTotalCost();
-
-					assertExpression(!child->inOpen && !child->inClosed);
-					open.Push(child);
+					child->parentCost = neighbors[i].cost;
+					child->CalcTotalCost();
+					open.Update(child);
 				}
 			}
+			else
+			{
+				child->parent = node;
+				child->costFromStart = newCost;
+				child->parentCost = neighbors[i].cost;
+				child->estToGoal = 0;
+				child->CalcTotalCost();
+				open.Push(child);
+			}
 		}
 	}
+}
+
+template<typename Cost>
+void BasicFlowField<Cost>::Init(void* _goal, size_t denseCount)
+{
+	goal = _goal;
+	count = 0;
+	entries.clear();
+	denseNext.assign(denseCount, 0);
+	denseCost.assign(denseCount, CostInfinity<Cost>());
+}
+
+
+template<typename Cost>
+void BasicFlowField<Cost>::Set(void* state, void* next, Cost cost)
+{
+	if (denseCost.empty())
+	{
+		Entry entry = { state, next, cost };
+		entries.push_back(entry);
+		++count;
+		return;
+	}
 
-	if (pathCache)
+	size_t index = (uintptr_t)state - 1;
+	assertExpression(index < denseCost.size());
+	if (denseCost[index] == CostInfinity<Cost>())
+	{
+		++count;
+	}
+	denseNext[index] = static_cast<uint32_t>((uintptr_t)next);
+	denseCost[index] = cost;
+}
+
+
+template<typename Cost>
+void BasicFlowField<Cost>::Finish()
+{
+	std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) { return a.state < b.state; });
+}
+
+
+template<typename Cost>
+Cost BasicFlowField<Cost>::Next(void* state, void** next) const
+{
+	void* nextState = nullptr;
+	Cost cost = CostInfinity<Cost>();
+
+	if (!denseCost.empty())
+	{
+		size_t index = (uintptr_t)state - 1;
+		if (index < denseCost.size())
+		{
+			nextState = (void*)(uintptr_t)denseNext[index];
+			cost = denseCost[index];
+		}
+	}
+	else
+	{
+		auto it = std::lower_bound(entries.begin(), entries.end(), state,
+			[](const Entry& entry, void* s) { return entry.state < s; });
+		if (it != entries.end() && it->state == state)
+		{
+			nextState = it->next;
+			cost = it->cost;
+		}
+	}
+
+	if (next)
+	{
+		*next = nextState;
+	}
+	return cost;
+}
+
+
+template<typename Cost>
+BasicFlowFieldWorker<Cost>::BasicFlowFieldWorker(BasicGraph<Cost>* graph, unsigned allocate, unsigned typicalAdjacent, std::pmr::memory_resource* resource) :
+	pather(graph, allocate, typicalAdjacent, false, 0, resource)
+{}
+
+
+template<typename Cost>
+BasicFlowFieldWorker<Cost>::~BasicFlowFieldWorker()
+{
+	Wait();
+}
+
+
+template<typename Cost>
+void BasicFlowFieldWorker<Cost>::Build(void* goal)
+{
+	Wait();
+
+	busy = true;
+	thread = std::thread([this, goal]()
+	{
+		auto built = std::make_shared<FlowField>();
+		pather.SolveFlowField(goal, built.get());
+		std::atomic_store(&field, std::shared_ptr<const FlowField>(std::move(built)));
+		busy = false;
+	});
+}
+
+
+template<typename Cost>
+void BasicFlowFieldWorker<Cost>::Wait()
+{
+	if (thread.joinable())
+	{
+		thread.join();
+	}
+}
+
+
+template<typename Cost>
+BasicGridGraph<Cost>::BasicGridGraph(int _width, int _height, GridMoves _moves, Cost _straight, Cost _diagonal) :
+	width{ _width },
+	height{ _height },
+	wordsPerRow{ (_width + 2 + 63) / 64 },
+	moves{ _moves },
+	straight{ _straight },
+	diagonal{ _diagonal }
+{
+	assertExpression(width > 0 && height > 0);
+	bits.resize((height + 2) * wordsPerRow, 0);
+}
+
+
+template<typename Cost>
+void BasicGridGraph<Cost>::SetPassable(int x, int y, bool passable)
+{
+	assertExpression(x >= 0 && x < width && y >= 0 && y < height);
+	uint64_t& word = bits[(y + 1) * wordsPerRow + ((x + 1) >> 6)];
+	uint64_t bit = uint64_t(1) << ((x + 1) & 63);
+	word = passable ? (word | bit) : (word & ~bit);
+}
+
+
+template<typename Cost>
+bool BasicGridGraph<Cost>::Passable(int x, int y) const
+{
+	if (x < 0 || x >= width || y < 0 || y >= height)
+	{
+		return false;
+	}
+	return (Window(x, y) & 2) != 0;
+}
+
+
+template<typename Cost>
+void BasicGridGraph<Cost>::StateToXY(void* state, int* x, int* y) const
+{
+	int index = static_cast<int>((intptr_t)state) - 1;
+	*y = index / width;
+	*x = index - *y * width;
+}
+
+
+template<typename Cost>
+uint32_t BasicGridGraph<Cost>::Window(int x, int y) const
+{
+	// Columns x-1 .. x+1 are bits x .. x+2 of the padded row, which may straddle a word.
+	const uint64_t* row = &bits[(y + 1) * wordsPerRow];
+	int word = x >> 6;
+	int shift = x & 63;
+
+	uint64_t window = row[word] >> shift;
+	if (shift > 61)
+	{
+		window |= row[word + 1] << (64 - shift);
+	}
+	return static_cast<uint32_t>(window & 7);
+}
+
+
+template<typename Cost>
+Cost BasicGridGraph<Cost>::LeastCostEstimate(void* stateStart, void* stateEnd)
+{
+	int x0, y0, x1, y1;
+	StateToXY(stateStart, &x0, &y0);
+	StateToXY(stateEnd, &x1, &y1);
+
+	Cost dx = static_cast<Cost>(x0 > x1 ? x0 - x1 : x1 - x0);
+	Cost dy = static_cast<Cost>(y0 > y1 ? y0 - y1 : y1 - y0);
+
+	if (moves == GridMoves::Four)
+	{
+		return (dx + dy) * straight;
+	}
+
+	// Octile distance. A diagonal never costs more than the two straight moves it replaces.
+	Cost diag = diagonal < straight + straight ? diagonal : straight + straight;
+	Cost lo = dx < dy ? dx : dy;
+	Cost hi = dx < dy ? dy : dx;
+	return lo * diag + (hi - lo) * straight;
+}
+
+
+template<typename Cost>
+void BasicGridGraph<Cost>::AdjacentCost(void* state, std::vector< StateCost >* adjacent)
+{
+	StateCost buffer[8];
+	int count = AdjacentCostArray(state, buffer);
+	adjacent->insert(adjacent->end(), buffer, buffer + count);
+}
+
+
+template<typename Cost>
+int BasicGridGraph<Cost>::AdjacentCostArray(void* state, StateCost* adjacent)
+{
+	// E, N, W, S, NE, NW, SW, SE
+	static const int dx[8] = { 1, 0, -1, 0, 1, -1, -1, 1 };
+	static const int dy[8] = { 0, -1, 0, 1, -1, -1, 1, 1 };
+
+	int x, y;
+	StateToXY(state, &x, &y);
+
+	uint32_t above = Window(x, y - 1);
+	uint32_t row = Window(x, y);
+	uint32_t below = Window(x, y + 1);
+
+	// Bits 0-3: E, N, W, S.
+	uint32_t mask = ((row >> 2) & 1) | (above & 2) | ((row & 1) << 2) | ((below & 2) << 2);
+
+	if (moves != GridMoves::Four)
+	{
+		// Bits 0-3 of 'diag': NE, NW, SW, SE. Each diagonal sits between straight
+		// directions i and i+1, so rotating the straight mask lines the pairs up.
+		uint32_t diag = ((above >> 2) & 1) | ((above & 1) << 1) | ((below & 1) << 2) | ((below & 4) << 1);
+		uint32_t rotated = (mask >> 1) | ((mask & 1) << 3);
+
+		if (moves == GridMoves::EightNoSqueeze)
+		{
+			diag &= mask | rotated;
+		}
+		else if (moves == GridMoves::EightNoCut)
+		{
+			diag &= mask & rotated;
+		}
+		mask |= diag << 4;
+	}
+
+	int count = 0;
+	while (mask)
+	{
+		int dir = BitWidth(mask & (~mask + 1)) - 1;
+		mask &= mask - 1;
+
+		adjacent[count].state = State(x + dx[dir], y + dy[dir]);
+		adjacent[count].cost = dir < 4 ? straight : diagonal;
+		++count;
+	}
+	return count;
+}
+
+
+template<typename Cost>
+bool BasicGridGraph<Cost>::BuildFlowField(void* goal, BasicFlowField<Cost>* field)
+{
+	// Dijkstra over cell indices with a binary heap, using the field as the cost table.
+	// Moves are symmetric, so searching out from the goal gives the costs to it.
+	struct Item
+	{
+		Cost cost;
+		uint32_t state;
+		bool operator<(const Item& rhs) const { return cost > rhs.cost; }
+	};
+
+	field->Init(goal, static_cast<size_t>(width) * height);
+	field->Set(goal, nullptr, 0);
+
+	std::vector<Item> heap;
+	heap.push_back({ Cost(0), static_cast<uint32_t>((uintptr_t)goal) });
+
+	StateCost adjacent[8];
+	while (!heap.empty())
+	{
+		std::pop_heap(heap.begin(), heap.end());
+		Item item = heap.back();
+		heap.pop_back();
+
+		void* state = (void*)(uintptr_t)item.state;
+		if (item.cost > field->Next(state, nullptr))
+		{
+			continue;	// superseded by a cheaper entry
+		}
+
+		int count = AdjacentCostArray(state, adjacent);
+		for (int i = 0; i < count; ++i)
+		{
+			Cost cost = AddCost(item.cost, adjacent[i].cost);
+			if (cost < field->Next(adjacent[i].state, nullptr))
+			{
+				field->Set(adjacent[i].state, state, cost);
+				heap.push_back({ cost, static_cast<uint32_t>((uintptr_t)adjacent[i].state) });
+				std::push_heap(heap.begin(), heap.end());
+			}
+		}
+	}
+	return true;
+}
+
+
+template<typename Cost>
+BasicSharedPathCache<Cost>::BasicSharedPathCache(int nShards, int itemsPerShard, std::pmr::memory_resource* resource) :
+	shards(std::pmr::polymorphic_allocator<Shard>(resource))
+{
+	assertExpression(nShards > 0);
+	for (int i = 0; i < nShards; ++i)
+	{
+		shards.emplace_back(itemsPerShard, resource);
+	}
+}
+
+
+template<typename Cost>
+size_t BasicSharedPathCache<Cost>::ShardIndex(void* end) const
+{
+	// Fibonacci hashing spreads the end states evenly over the shards.
+	uint64_t hash = static_cast<uint64_t>(reinterpret_cast<uintptr_t>(end)) * 0x9E3779B97F4A7C15ull;
+	return (hash >> 32) % shards.size();
+}
+
+
+template<typename Cost>
+std::unique_lock<std::mutex> BasicSharedPathCache<Cost>::Lock(void* end, PathCache** cache)
+{
+	Shard& shard = shards[ShardIndex(end)];
+
+	std::unique_lock<std::mutex> lock(shard.mutex);
+	uint32_t current = epoch.load();
+	if (shard.epoch != current)
+	{
+		shard.cache.Clear();
+		shard.epoch = current;
+	}
+	*cache = &shard.cache;
+	return lock;
+}
+
+
+template<typename Cost>
+void BasicSharedPathCache<Cost>::SetBudget(size_t bytes, bool autoResize)
+{
+	for (auto& shard : shards)
+	{
+		std::lock_guard<std::mutex> lock(shard.mutex);
+		shard.cache.SetBudget(bytes / shards.size(), autoResize);
+	}
+}
+
+
+template<typename Cost>
+void BasicSharedPathCache<Cost>::GetShardData(std::vector<CacheData>* data)
+{
+	data->resize(shards.size());
+	for (size_t i = 0; i < shards.size(); ++i)
+	{
+		std::lock_guard<std::mutex> lock(shards[i].mutex);
+		shards[i].cache.GetData(&(*data)[i]);
+	}
+}
+
+
+template<typename Cost>
+bool BasicSharedPathCache<Cost>::Save(const char* filename, StateIDMap* map)
+{
+	FILE* fp = fopen(filename, "wb");
+	if (!fp)
+	{
+		return false;
+	}
+
+	// Hold every shard, in order, so the count in the header is the count written.
+	// Shards from an earlier epoch are as good as empty.
+	std::vector< std::unique_lock<std::mutex> > locks;
+	const uint32_t current = epoch.load();
+	int count = 0;
+	for (auto& shard : shards)
+	{
+		locks.emplace_back(shard.mutex);
+		count += shard.epoch == current ? shard.cache.Count() : 0;
+	}
+
+	bool ok = PathCache::WriteHeader(fp, count);
+	for (size_t i = 0; ok && i < shards.size(); ++i)
+	{
+		ok = shards[i].epoch != current || shards[i].cache.WriteItems(fp, map);
+	}
+	return fclose(fp) == 0 && ok;
+}
+
+
+template<typename Cost>
+bool BasicSharedPathCache<Cost>::Load(const void* image, size_t bytes, StateIDMap* map)
+{
+	int count = 0;
+	const typename PathCache::FileItem* items = PathCache::ReadImage(image, bytes, &count);
+	if (!items)
+	{
+		return false;
+	}
+
+	// Size each shard for its share before filling them.
+	std::vector<int> counts(shards.size(), 0);
+	for (int i = 0; i < count; ++i)
+	{
+		void* end = map->IDState(items[i].end);
+		counts[ShardIndex(end)] += end ? 1 : 0;
+	}
+	for (size_t i = 0; i < shards.size(); ++i)
+	{
+		std::lock_guard<std::mutex> lock(shards[i].mutex);
+		shards[i].cache.Clear();
+		shards[i].cache.Reserve(counts[i]);
+		shards[i].epoch = epoch.load();
+	}
+
+	// Paths first, as in PathCache::Load().
+	for (int pass = 0; pass < 2; ++pass)
+	{
+		for (int i = 0; i < count; ++i)
+		{
+			void* end = map->IDState(items[i].end);
+			if (end && (items[i].next != StateIDMap::NoStateID) == (pass == 0))
+			{
+				PathCache* cache = nullptr;
+				auto lock = Lock(end, &cache);
+				cache->LoadItem(items[i], map);
+			}
+		}
+	}
+	return true;
+}
+
+
+template<typename Cost>
+bool BasicSharedPathCache<Cost>::Load(const char* filename, StateIDMap* map)
+{
+	std::vector<uint64_t> data;
+	size_t bytes = 0;
+	return ReadFile(filename, &data, &bytes) && Load(data.data(), bytes, map);
+}
+
+
+template<typename Cost>
+bool BasicSharedPathCache<Cost>::Solve(void* start, void* end, std::vector<void*>* path, Cost* totalCost)
+{
+	PathCache* cache = nullptr;
+	auto lock = Lock(end, &cache);
+	return cache->Solve(start, end, path, totalCost);
+}
+
+
+template<typename Cost>
+bool BasicSharedPathCache<Cost>::Solve(void* start, void* end, std::pmr::vector<void*>* path, Cost* totalCost)
+{
+	PathCache* cache = nullptr;
+	auto lock = Lock(end, &cache);
+	return cache->Solve(start, end, path, totalCost);
+}
+
+
+template<typename Cost>
+bool BasicSharedPathCache<Cost>::Solve(void* start, void* end, PathArena::Tail* path, Cost* totalCost)
+{
+	PathCache* cache = nullptr;
+	auto lock = Lock(end, &cache);
+	return cache->Solve(start, end, path, totalCost);
+}
+
+
+template<typename Cost>
+bool BasicSharedPathCache<Cost>::Next(void* state, void* end, void** next, Cost* remaining)
+{
+	PathCache* cache = nullptr;
+	auto lock = Lock(end, &cache);
+	return cache->Next(state, end, next, remaining);
+}
+
+
+template<typename Cost>
+bool BasicSharedPathCache<Cost>::Follow(void* state, void* end, std::pmr::vector<void*>* states, std::pmr::vector<Cost>* steps)
+{
+	PathCache* cache = nullptr;
+	auto lock = Lock(end, &cache);
+	return cache->Follow(state, end, states, steps);
+}
+
+
+template<typename Cost>
+bool BasicSharedPathCache<Cost>::MayHavePathsTo(void* end)
+{
+	PathCache* cache = nullptr;
+	auto lock = Lock(end, &cache);
+	return cache->MayHavePathsTo(end);
+}
+
+
+template<typename Cost>
+void BasicSharedPathCache<Cost>::Next(void* const* states, int count, void* end, Cost* remaining)
+{
+	PathCache* cache = nullptr;
+	auto lock = Lock(end, &cache);
+	for (int i = 0; i < count; ++i)
+	{
+		void* next = nullptr;
+		if (!cache->Next(states[i], end, &next, &remaining[i]))
+		{
+			remaining[i] = CostInfinity<Cost>();
+		}
+	}
+}
+
+
+template<typename Cost>
+void BasicSharedPathCache<Cost>::Add(void* const* path, const Cost* cost, size_t count, uint32_t since)
+{
+	PathCache* cache = nullptr;
+	auto lock = Lock(path[count - 1], &cache);
+	if (since == epoch.load())
+	{
+		cache->Add(path, cost, count);
+	}
+}
+
+
+template<typename Cost>
+void BasicSharedPathCache<Cost>::AddNoSolution(void* end, void* states[], int count, uint32_t since)
+{
+	PathCache* cache = nullptr;
+	auto lock = Lock(end, &cache);
+	if (since == epoch.load())
 	{
-		pathCache->AddNoSolution(endNode, &startNode, 1);
+		cache->AddNoSolution(end, states, count);
 	}
+}
 
-	return {};
+
+namespace micropather
+{
+	template class BasicPathNode<float>;
+	template class BasicPathNodePool<float>;
+	template class BasicPathCache<float>;
+	template class BasicSharedPathCache<float>;
+	template class BasicMicroPather<float>;
+	template class BasicGridGraph<float>;
+	template class BasicFlowField<float>;
+	template class BasicFlowFieldWorker<float>;
+
+	template class BasicPathNode<double>;
+	template class BasicPathNodePool<double>;
+	template class BasicPathCache<double>;
+	template class BasicSharedPathCache<double>;
+	template class BasicMicroPather<double>;
+	template class BasicGridGraph<double>;
+	template class BasicFlowField<double>;
+	template class BasicFlowFieldWorker<double>;
+
+	template class BasicPathNode<uint32_t>;
+	template class BasicPathNodePool<uint32_t>;
+	template class BasicPathCache<uint32_t>;
+	template class BasicSharedPathCache<uint32_t>;
+	template class BasicMicroPather<uint32_t>;
+	template class BasicGridGraph<uint32_t>;
+	template class BasicFlowField<uint32_t>;
+	template class BasicFlowFieldWorker<uint32_t>;
 }
@@ -27,23 +27,135 @@ distribution.
 
 
 #include <float.h>
+#include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
 
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <limits>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <thread>
 #include <vector>
 
 
 namespace micropather
 {
+	/**
+		The cost used to mark an impassable neighbor, and the value of an unknown cost.
+		MicroPather is instantiated for float, double and uint32_t costs. Use double for
+		accuracy on very large maps, or uint32_t (a fixed-point cost, scaled by the client)
+		for graphs with integer costs.
+	*/
+	template<typename Cost>
+	constexpr Cost CostInfinity() { return std::numeric_limits<Cost>::max(); }
+
+
 	/**
 		Used to pass the cost of states from the cliet application to MicroPather. This
 		structure is copied in a vector.
 
 		@sa AdjacentCost
 	*/
-	struct StateCost
+	template<typename Cost>
+	struct BasicStateCost
 	{
 		void* state; ///< The state as a void*
-		float cost; ///< The cost to the state. Use FLT_MAX for infinite cost.
+		Cost cost; ///< The cost to the state. Use CostInfinity<Cost>() (FLT_MAX for float) for infinite cost.
+	};
+
+
+	/**
+		Selects the open list used by MicroPather::Solve().
+
+		Sorted is a general purpose sorted list. Radix is a monotone radix heap: nodes are
+		bucketed by the integer image of their total cost, so pushes, updates and most pops
+		are O(1) with no float comparisons. Radix is the better choice for graphs with
+		small integer costs (or any graph with a large open set), but it requires a
+		consistent heuristic; an estimate that drops by more than the edge cost is
+		clamped, which can yield a slightly longer path.
+	*/
+	enum class OpenList
+	{
+		Sorted,
+		Radix
+	};
+
+
+	/**
+		Selects how the open list orders nodes with equal total cost.
+
+		Insertion pops equal-cost nodes in the order they were added, which depends on the
+		order AdjacentCost() lists neighbors. Deterministic prefers the node with the higher
+		cost from start (the one closer to the goal), then the lower state value, so the
+		path is a function of the graph's costs and states alone. It also expands far fewer
+		nodes on plateaus, such as open grids, where many nodes share a total cost.
+
+		Identical paths across compilers and platforms additionally need identical cost
+		values: use an integer cost type (BasicMicroPather<uint32_t>) or a float
+		environment without extended precision or contraction. States are compared as
+		integers, so pointer states are only reproducible if their addresses are. Paths
+		served from the path cache are suffixes of earlier solves, so they depend on query
+		history; disable the cache if that matters.
+	*/
+	enum class TieBreak
+	{
+		Insertion,
+		Deterministic
+	};
+
+
+	/**
+		A flow field: for every state that can reach one goal, the next state on a cheapest
+		path to it and the cost of getting there. Agents heading for the same place each
+		follow Next() rather than solving their own path.
+
+		Filled by MicroPather::SolveFlowField(), or by Graph::BuildFlowField() for graphs
+		with a fast path. The table is sorted by state; a graph whose states are the
+		integers 1 to N (such as GridGraph) can ask for flat arrays instead.
+	*/
+	template<typename Cost>
+	class BasicFlowField
+	{
+	public:
+		/**
+			Empty the field and set its goal. If 'denseCount' is not zero the states are
+			the integers 1 to denseCount, and are looked up by index.
+		*/
+		void Init(void* goal, size_t denseCount = 0);
+
+		/// Record the next state and cost to the goal of 'state'. Call Finish() when done.
+		void Set(void* state, void* next, Cost cost);
+		void Finish();
+
+		/**
+			Return the cost from 'state' to the goal, and write the next state on the way
+			to 'next' if not null. The next state of the goal is null. States that can't
+			reach the goal cost CostInfinity<Cost>().
+		*/
+		Cost Next(void* state, void** next) const;
+
+		void* Goal() const { return goal; }
+
+		/// The number of states that can reach the goal, including the goal itself.
+		size_t Size() const { return count; }
+
+	private:
+		struct Entry
+		{
+			void* state;
+			void* next;
+			Cost cost;
+		};
+
+		void* goal{ nullptr };
+		size_t count{ 0 };
+		std::vector<Entry> entries;			// sorted by state
+		std::vector<uint32_t> denseNext;	// next state by index; 0 is none
+		std::vector<Cost> denseCost;
 	};
 
 
@@ -61,10 +173,11 @@ namespace micropather
 		values, (x,y) for example, then state is an encoding of these values. MicroPather
 		never interprets or modifies the value of state.
 	*/
-	class Graph
+	template<typename Cost>
+	class BasicGraph
 	{
 	public:
-		virtual ~Graph() {}
+		virtual ~BasicGraph() {}
 
 		/**
 			Return the least possible cost between 2 states. For example, if your pathfinding
@@ -72,7 +185,41 @@ namespace micropather
 			map. If you pathfinding is based on minimum time, it is the minimal travel time
 			between 2 points given the best possible terrain.
 		*/
-		virtual float LeastCostEstimate(void* stateStart, void* stateEnd) = 0;
+		virtual Cost LeastCostEstimate(void* stateStart, void* stateEnd) = 0;
+
+		/**
+			Write LeastCostEstimate(states[i], stateEnd) to out[i] for each of the n states.
+			The solver calls this once per expansion for all the newly reached neighbors,
+			so a graph with a simple estimate (a grid, say) can vectorize it. The default
+			calls LeastCostEstimate() for each state.
+		*/
+		virtual void LeastCostEstimateBatch(void* const* states, int n, void* stateEnd, Cost* out)
+		{
+			for (int i = 0; i < n; ++i)
+			{
+				out[i] = LeastCostEstimate(states[i], stateEnd);
+			}
+		}
+
+		/**
+			Return the least possible cost from 'state' to the nearest of the nGoals goal
+			states. Used by MicroPather::SolveToAny(). The default is the smallest
+			LeastCostEstimate() to any of the goals; override it if the graph can do better
+			than a linear scan (a distance field, a spatial index of the goals).
+		*/
+		virtual Cost LeastCostEstimateToAny(void* state, void* const* goals, int nGoals)
+		{
+			Cost best = CostInfinity<Cost>();
+			for (int i = 0; i < nGoals; ++i)
+			{
+				Cost estimate = LeastCostEstimate(state, goals[i]);
+				if (estimate < best)
+				{
+					best = estimate;
+				}
+			}
+			return best;
+		}
 
 		/**
 			Return the exact cost from the given state to all its neighboring states. This
@@ -80,16 +227,65 @@ namespace micropather
 			exact values for every call to MicroPather::Solve(). It should generally be a simple,
 			fast function with no callbacks into the pather.
 		*/
-		virtual void AdjacentCost(void* state, std::vector< micropather::StateCost >* adjacent) = 0;
+		virtual void AdjacentCost(void* state, std::vector< BasicStateCost<Cost> >* adjacent) = 0;
+
+		/**
+			Optional. Return the neighbors of several states in one call, for graphs where
+			each query is expensive (a database, a complex terrain model) and batching pays.
+			Append the neighbors of states[0], then states[1], and so on to 'adjacent', and
+			write the number appended for states[i] to counts[i]. The same rules as
+			AdjacentCost() apply.
+
+			The solver passes the node it is expanding plus the nodes at the front of the
+			open list whose neighbors are not yet known. Return false (the default) if not
+			implemented; the solver then uses AdjacentCost() and stops asking.
+		*/
+		virtual bool AdjacentCostBatch(void* const* /*states*/, int /*nStates*/, std::vector< BasicStateCost<Cost> >* /*adjacent*/, int* /*counts*/)
+		{
+			return false;
+		}
+
+		/**
+			Optional, for the searches that run backwards from the goal (such as
+			MicroPather::SolveFromMany()). Write the states that have 'state' as a neighbor
+			to 'adjacent', each with the cost of the step from it to 'state'. Return false
+			(the default) if not implemented; the graph is then taken to be symmetric, and
+			AdjacentCost() is used. A graph where a step costs more one way than the other
+			must implement it.
+		*/
+		virtual bool ReverseAdjacentCost(void* /*state*/, std::vector< BasicStateCost<Cost> >* /*adjacent*/)
+		{
+			return false;
+		}
+
+		/**
+			Optional fast path for graphs with a small, fixed maximum number of neighbors,
+			such as grids. Return that maximum; the default, 0, means not supported. The
+			solver then calls AdjacentCostArray() with room for MaxAdjacent() entries in
+			place of AdjacentCost(), which skips the vector.
+		*/
+		virtual int MaxAdjacent() { return 0; }
+
+		/// Write the neighbors of 'state' to 'adjacent' and return how many were written.
+		virtual int AdjacentCostArray(void* /*state*/, BasicStateCost<Cost>* /*adjacent*/) { return 0; }
+
+		/**
+			Optional. Fill 'field' with the flow field to 'goal' without going through the
+			solver, for graphs that can do it faster themselves. Return false (the default)
+			to have MicroPather::SolveFlowField() run its own search.
+		*/
+		virtual bool BuildFlowField(void* /*goal*/, BasicFlowField<Cost>* /*field*/) { return false; }
 	};
 
 
-	class PathNode;
+	template<typename Cost>
+	class BasicPathNode;
 
-	struct NodeCost
+	template<typename Cost>
+	struct BasicNodeCost
 	{
-		PathNode* node;
-		float cost;
+		BasicPathNode<Cost>* node;
+		Cost cost;
 	};
 
 
@@ -97,65 +293,76 @@ namespace micropather
 		Every state (void*) is represented by a PathNode in MicroPather. There
 		can only be one PathNode for a given state.
 	*/
-	class PathNode
+	template<typename Cost>
+	class BasicPathNode
 	{
 	public:
-		PathNode() = delete;
-		PathNode(const PathNode&) = delete;
-		PathNode& operator=(const PathNode&) = delete;
+		BasicPathNode() = delete;
+		BasicPathNode(const BasicPathNode&) = delete;
+		BasicPathNode& operator=(const BasicPathNode&) = delete;
 
-		PathNode(PathNode&&) = delete; /// todo: allow for move semantics
-		PathNode& operator=(PathNode&&) = delete; /// todo: allow for move semantics
+		BasicPathNode(BasicPathNode&&) = delete; /// todo: allow for move semantics
+		BasicPathNode& operator=(BasicPathNode&&) = delete; /// todo: allow for move semantics
 
-		PathNode(uint32_t _frame,
+		BasicPathNode(uint32_t _frame,
 			void* _state,
-			float _costFromStart,
-			float _estToGoal,
-			PathNode* _parent);
+			Cost _costFromStart,
+			Cost _estToGoal,
+			BasicPathNode* _parent);
 
 
 		void Init(unsigned _frame,
 			void* _state,
-			float _costFromStart,
-			float _estToGoal,
-			PathNode* _parent);
+			Cost _costFromStart,
+			Cost _estToGoal,
+			BasicPathNode* _parent);
 
 		void Clear();
-		
+
 		void InitSentinel();
 
 		void* state;			// the client state
-		float costFromStart;	// exact
-		float estToGoal;		// estimated
-		float totalCost;		// could be a function, but save some math.
-		PathNode* parent;		// the parent is used to reconstruct the path
+		Cost costFromStart;		// exact
+		Cost estToGoal;			// estimated
+		Cost totalCost;			// could be a function, but save some math.
+		Cost parentCost;		// cost of the step from the parent
+		BasicPathNode* parent;	// the parent is used to reconstruct the path
 		uint32_t frame;			// unique id for this path, so the solver can distinguish
 		// correct from stale values
 
 		int numAdjacent;		// -1  is unknown & needs to be queried
 		int cacheIndex;			// position in cache
 
-		PathNode* child[2];		// Binary search in the hash table. [left, right]
-		PathNode* next, * prev;	// used by open queue
+		Cost estimate;			// LeastCostEstimate() to the goal of estimateStamp. Unlike
+		uint32_t estimateStamp;	// estToGoal, kept across frames.
+
+		BasicPathNode* child[2];	// Binary search in the hash table. [left, right]
+		BasicPathNode* next, * prev;	// used by open queue
 
 		bool inOpen;
 		bool inClosed;
 
 		void Unlink();
-		
-		void AddBefore(PathNode* addThis);
+
+		void AddBefore(BasicPathNode* addThis);
 		void CalcTotalCost();
 	};
 
 
 	/* Memory manager for the PathNodes. */
-	class PathNodePool
+	template<typename Cost>
+	class BasicPathNodePool
 	{
 	public:
-		PathNodePool(unsigned allocate, unsigned typicalAdjacent);
-		~PathNodePool();
+		using PathNode = BasicPathNode<Cost>;
+		using NodeCost = BasicNodeCost<Cost>;
+
+		// Blocks, the hash table and the neighbor cache all come from 'resource'.
+		BasicPathNodePool(unsigned allocate, unsigned typicalAdjacent, std::pmr::memory_resource* resource);
+		~BasicPathNodePool();
 
-		// Free all the memory except the first block. Resets all memory.
+		// Empty the pool. Blocks up to the retention limit are kept for reuse, the rest
+		// are freed. Kept nodes aren't touched until they are handed out again.
 		void Clear();
 
 		// Essentially:
@@ -164,7 +371,7 @@ namespace micropather
 		//		pNode = New();
 		//
 		// Get the PathNode associated with this state. If the PathNode already
-		// exists (allocated and is on the current frame), it will be returned. 
+		// exists (allocated and is on the current frame), it will be returned.
 		// Else a new PathNode is allocated and returned. The returned object
 		// is always fully initialized.
 		//
@@ -172,24 +379,48 @@ namespace micropather
 		//       parameters are ignored.
 		PathNode* GetPathNode(unsigned frame,
 			void* _state,
-			float _costFromStart,
-			float _estToGoal,
+			Cost _costFromStart,
+			Cost _estToGoal,
 			PathNode* _parent);
 
 		// Get a pathnode that is already in the pool.
 		PathNode* FetchPathNode(void* state);
 
-		// Store stuff in cache
-		bool PushCache(const NodeCost* nodes, int nNodes, int* start);
+		// Store the neighbors of 'owner' in the cache. The cache grows a chunk at a time
+		// up to its budget; then the chunks are reused as a ring, the oldest first, and
+		// the lists in a chunk are evicted when it is reused.
+		bool PushCache(PathNode* owner, const NodeCost* nodes, int nNodes, int* start);
 
-		// Get neighbors from the cache
-		// Note - always access this with an offset. Can get re-allocated.
-		void GetCache(int start, int nNodes, NodeCost* nodes);
+		// Get neighbors from the cache, in place. The list stays put until the next
+		// PushCache(), which can evict it.
+		const NodeCost* GetCache(int start, int nNodes) const;
+
+		// Limit the neighbor cache to about 'bytes', and empty it; 0 is no limit. Small
+		// budgets get small chunks, down to MinChunkSize entries, the least it will use.
+		void SetCacheBudget(size_t bytes);
+		size_t CacheBytes() const { return cacheChunks.size() * chunkSize * sizeof(NodeCost); }
+		uint32_t CacheEvictions() const { return cacheEvictions; }
+		void ClearCacheEvictions() { cacheEvictions = 0; }
 
 		// Return all the allocated states. Useful for visuallizing what
 		// the pather is doing.
 		void AllStates(uint32_t frame, std::vector< void* >* stateVec);
 
+		// Return the states closed by the search of this frame.
+		void ClosedStates(uint32_t frame, std::pmr::vector< void* >* stateVec);
+
+		// Limit the pool to 'maxNodes' nodes (0 is no limit). Once no more blocks fit
+		// under it, GetPathNode() returns null for new states.
+		void SetMaxNodes(uint32_t maxNodes) { this->maxNodes = maxNodes; }
+		uint32_t GetMaxNodes() const { return maxNodes; }
+
+		// Keep up to 'bytes' of blocks (but at least one) across Clear().
+		void SetRetainBytes(size_t bytes);
+		size_t BlockBytes() const { return sizeof(Block) + sizeof(PathNode) * (allocate - 1); }
+
+		uint32_t Allocated() const { return nAllocated; }
+		uint32_t PeakAllocated() const { return nAllocated > peakAllocated ? nAllocated : peakAllocated; }
+
 	private:
 		struct Block
 		{
@@ -203,26 +434,147 @@ namespace micropather
 		void AddPathNode(uint32_t key, PathNode* p);
 		Block* NewBlock();
 		PathNode* Alloc();
+		void EvictChunk(size_t chunk);
+		void ResetCache(int newChunkSize);
+		NodeCost* NewChunk();
 
-		PathNode** hashTable;
-		Block* firstBlock;
-		Block* blocks;
+		static constexpr int MinChunkSize = 64;
 
-		NodeCost* cache;
-		int cacheCap;
-		int cacheSize;
+		std::pmr::memory_resource* resource;
+		PathNode** hashTable;
+		Block* firstBlock;		// blocks in allocation order, including retained ones
+		Block* currentBlock;	// the block nodes are being handed out from
+
+		// Neighbor lists are stored at an index of chunk * chunkSize + offset, and are
+		// never split between chunks.
+		std::pmr::vector<NodeCost*> cacheChunks;
+		std::pmr::vector< std::pmr::vector<PathNode*> > chunkOwners;	// the nodes with lists in each chunk
+		int chunkSize;
+		int defaultChunkSize;	// used when there is no budget
+		int cacheSize;			// next free index
+		size_t maxChunks{ 0 };	// 0 is no limit
+		uint32_t cacheEvictions{ 0 };
 
-		PathNode freeMemSentinel;
 		uint32_t allocate; // how big a block of pathnodes to allocate at once
 		uint32_t nAllocated; // number of pathnodes allocated (from Alloc())
-		uint32_t nAvailable; // number available for allocation
+		uint32_t nUsed; // number of pathnodes used in currentBlock
+		uint32_t retainBlocks{ 1 }; // blocks kept by Clear()
+		uint32_t maxNodes{ 0 }; // limit on nAllocated, rounded down to whole blocks; 0 is none
+		uint32_t peakAllocated{ 0 }; // most nodes allocated before a Clear()
 
 		uint32_t hashShift;
 		uint32_t totalCollide;
 	};
 
 
-	class PathCache
+	/**
+		Storage for many paths back to back in one buffer, filled by
+		MicroPather::SolveSpan(). Clear() recycles the memory, and invalidates every
+		PathSpan into the arena.
+	*/
+	class PathArena
+	{
+	public:
+		// Not states{ resource }: that would be a list of one void*, the resource itself.
+		explicit PathArena(std::pmr::memory_resource* resource = std::pmr::get_default_resource()) :
+			states(std::pmr::polymorphic_allocator<void*>(resource))
+		{}
+
+		void Clear() { states.clear(); }
+
+		/// Every path in the arena, in the order they were added.
+		void* const* Data() const { return states.data(); }
+		size_t Size() const { return states.size(); }
+
+		// The end of the arena, written through the same calls as a vector. A new
+		// path is built here in place.
+		class Tail
+		{
+		public:
+			explicit Tail(std::pmr::vector<void*>* _states) : states{ _states }, start{ _states->size() } {}
+
+			void clear() { states->resize(start); }
+			void push_back(void* state) { states->push_back(state); }
+			void resize(size_t count) { states->resize(start + count); }
+			size_t size() const { return states->size() - start; }
+			bool empty() const { return states->size() == start; }
+			void*& operator[](size_t i) { return (*states)[start + i]; }
+
+			size_t Start() const { return start; }
+
+		private:
+			std::pmr::vector<void*>* states;
+			size_t start;
+		};
+
+		Tail Append() { return Tail(&states); }
+
+	private:
+		std::pmr::vector<void*> states;
+	};
+
+
+	/// A path in a PathArena, held by position so it survives the arena growing. Valid until the arena is cleared.
+	class PathSpan
+	{
+	public:
+		PathSpan() = default;
+		PathSpan(const PathArena* _arena, size_t _offset, size_t _count) : arena{ _arena }, offset{ _offset }, count{ _count } {}
+
+		void* const* begin() const { return count ? arena->Data() + offset : nullptr; }
+		void* const* end() const { return begin() + count; }
+		void* operator[](size_t i) const { return arena->Data()[offset + i]; }
+		size_t size() const { return count; }
+		bool empty() const { return count == 0; }
+
+		/// Where the path starts in PathArena::Data().
+		size_t Offset() const { return offset; }
+
+	private:
+		const PathArena* arena{ nullptr };
+		size_t offset{ 0 };
+		size_t count{ 0 };
+	};
+
+
+	/**
+		Maps states to integer IDs and back, so a path cache saved by one process can be
+		loaded by another, where the states are different pointers. See PathCache::Save().
+	*/
+	class StateIDMap
+	{
+	public:
+		/// Not a state; don't use it as an ID.
+		static constexpr uint32_t NoStateID = 0xffffffff;
+
+		virtual ~StateIDMap() {}
+
+		/// The ID of 'state'.
+		virtual uint32_t StateID(void* state) = 0;
+
+		/// The state with 'id', or null if there no longer is one.
+		virtual void* IDState(uint32_t id) = 0;
+	};
+
+
+	template<typename Cost>
+	class BasicSharedPathCache;
+
+
+	struct CacheData
+	{
+		int nBytesAllocated{ 0 };
+		int nBytesUsed{ 0 };
+		float memoryFraction{ 0.0f };
+
+		int hit{ 0 };
+		int miss{ 0 };
+		float hitFraction{ 0 };
+	};
+
+
+	template<typename Cost>
+	class BasicPathCache
 	{
 	public:
 		struct Item
@@ -242,7 +594,7 @@ namespace micropather
 				constexpr auto FnvOffset = 2166136261u;
 				constexpr auto FnvPrime = 16777619u;
 
-				const uint8_t* byte = static_cast<const uint8_t*>(start);
+				const uint8_t* byte = reinterpret_cast<const uint8_t*>(&start);
 				uint32_t hash = FnvOffset;
 
 				for (uint32_t i = 0; i < sizeof(void*) * 2; ++i, ++byte)
@@ -258,75 +610,704 @@ namespace micropather
 			void* end{ nullptr };
 
 			void* next{ nullptr };
-			float cost{ 0.0f };
+			Cost cost{ 0 };		// of the rest of the path, from start to end
 
 		};
 
-		PathCache(int maxItems);
-		~PathCache();
+		BasicPathCache(int maxItems, std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+		~BasicPathCache();
 
 		void Reset();
-		void Add(const std::vector<void*>& path, const std::vector<float>& cost);
+
+		// Limit the table to 'bytes'. Without 'autoResize' it is sized to the budget now,
+		// and stops taking entries when 3/4 full. With it, it keeps its size until it is
+		// 3/4 full; then it doubles if that fits in the budget and the cache is earning hits,
+		// and is emptied (keeping the counts) otherwise.
+		void SetBudget(size_t bytes, bool autoResize);
+		void Resize(int maxItems);
+		int Capacity() const { return mMaxItems; }
+		int Count() const { return mCount; }
+		void GetData(CacheData* data) const;
+
+		// Empty the table, keeping its size and the counts.
+		void Clear();
+
+		void Add(const std::vector<void*>& path, const std::vector<Cost>& cost);
+		void Add(void* const* path, const Cost* cost, size_t count);
 		void AddNoSolution(void* end, void* states[], int count);
 		std::vector<void*> Solve(void* startState, void* endState);
 
+		// Write the cached path to 'path', and its cost to 'totalCost' if not null. Returns
+		// false (and leaves it empty) on a miss. On a hit the path is empty if the cache
+		// knows there is no path; the cost is then CostInfinity().
+		bool Solve(void* startState, void* endState, std::vector<void*>* path, Cost* totalCost = nullptr);
+		bool Solve(void* startState, void* endState, std::pmr::vector<void*>* path, Cost* totalCost = nullptr);
+		bool Solve(void* startState, void* endState, PathArena::Tail* path, Cost* totalCost = nullptr);
+
+		// One step of a cached path: the state after 'state' on the way to 'end', and the
+		// cost from 'state' to 'end' (CostInfinity(), and no next state, if there is no
+		// path). Returns false if the cache doesn't know. Doesn't count as a hit or miss.
+		bool Next(void* state, void* end, void** next, Cost* remaining);
+
+		// False if no path to 'end' is cached; true if one may be. Costs a bit test, so
+		// a search can skip calling Next() for every state it expands.
+		bool MayHavePathsTo(void* end) const { return (mEnds[EndBit(end) / 64] >> (EndBit(end) % 64)) & 1; }
+
+		// Append the cached path from 'state' to 'end' to 'states' (not including 'state'),
+		// and the cost of each step to 'steps'. Returns false, adding nothing, if the cache
+		// has no complete path. Counts as a partial hit.
+		bool Follow(void* state, void* end, std::pmr::vector<void*>* states, std::pmr::vector<Cost>* steps);
+
+		// Write the cache to 'filename', with states as their 'map' IDs. The file is laid
+		// out as it is used, so it can be mapped into memory and passed to Load() as is.
+		bool Save(const char* filename, StateIDMap* map) const;
+
+		// Replace the contents with an 'image' of a file from Save(), growing the table
+		// to hold it if the budget allows. Entries for states 'map' no longer knows are
+		// dropped, as are those that would fill the table past 3/4 (no-solution entries
+		// first). Returns false if it isn't a saved cache of this Cost type.
+		bool Load(const void* image, size_t bytes, StateIDMap* map);
+		bool Load(const char* filename, StateIDMap* map);
+
 		int hit{ 0 };
 		int miss{ 0 };
+		int partial{ 0 };	// searches finished by splicing in a cached path
 
 	private:
+		friend class BasicSharedPathCache<Cost>;
+
+		// The saved form: a FileHeader, then 'count' FileItems.
+		struct FileHeader
+		{
+			uint32_t magic;
+			uint16_t version;
+			uint8_t costBytes;
+			uint8_t costIsInteger;
+			uint32_t itemBytes;
+			uint32_t count;
+		};
+
+		struct FileItem
+		{
+			uint32_t start;
+			uint32_t end;
+			uint32_t next;		// StateIDMap::NoStateID if there is no path
+			Cost cost;
+		};
+
+		static bool WriteHeader(FILE* fp, int count);
+		bool WriteItems(FILE* fp, StateIDMap* map) const;
+		static const FileItem* ReadImage(const void* image, size_t bytes, int* count);
+		void LoadItem(const FileItem& fileItem, StateIDMap* map);
+		void Reserve(int count);
+
 		void AddItem(const Item& item);
 		const Item* Find(void* start, void* end);
+		template<typename Path>
+		bool Fill(void* start, void* end, Path* path, Cost* totalCost);
+		bool MakeRoom(int needed);
+		static unsigned EndBit(void* end);
+
+		std::pmr::vector<Item> mItems;
+		int mMaxItems{ 0 };
+		int mCount{ 0 };	// items in use; kept to 3/4 of the table, so lookups stay short
+		int mNoSolution{ 0 };	// of which are for states with no path
+		uint64_t mEnds[16]{};	// a bit set for the end of each cached path (see MayHavePathsTo())
+		size_t mMaxBytes{ 0 };	// 0 is no budget
+		bool mAutoResize{ false };
+	};
 
-		std::vector<Item> mItems;
-		const int mMaxItems{ 0 };
+
+	/// Running totals kept by MicroPather. Cleared by MicroPather::ClearStats().
+	struct PatherStats
+	{
+		unsigned estimates{ 0 };		///< States passed to LeastCostEstimate() or LeastCostEstimateBatch().
+		unsigned estimatesSaved{ 0 };	///< Estimates reused rather than asked of the graph again.
+		unsigned nodeLimitHits{ 0 };	///< Searches that ran out of nodes (see SetNodeLimit()).
+		unsigned peakNodes{ 0 };		///< The most path nodes the pool has held. Not cleared.
+		unsigned nodeLimit{ 0 };		///< The current node limit; 0 is none.
+		unsigned neighborHits{ 0 };		///< Expansions served by the neighbor cache.
+		unsigned neighborMisses{ 0 };	///< Expansions that asked the graph for neighbors.
+		unsigned neighborEvictions{ 0 };	///< Neighbor lists dropped to stay within the cache budget.
+		size_t neighborCacheBytes{ 0 };	///< Memory held by the neighbor cache.
+		unsigned failuresAvoided{ 0 };	///< Searches skipped because the path cache knew there was no path.
 	};
 
 
-	struct CacheData
+	/// The outcome of the last search. See MicroPather::LastStatus().
+	enum class SolveStatus
 	{
-		int nBytesAllocated{ 0 };
-		int nBytesUsed{ 0 };
-		float memoryFraction{ 0.0f };
+		Solved,			///< A path (or the requested result) was found.
+		NoSolution,		///< No path exists.
+		StartEndSame,	///< The start is the goal; the path is empty.
+		NodeLimit		///< The search needed more nodes than SetNodeLimit() allows.
+	};
 
-		int hit{ 0 };
-		int miss{ 0 };
-		float hitFraction{ 0 };
+
+	/**
+		A path cache that several MicroPathers, on any threads, can share (see
+		MicroPather::SetSharedPathCache()), so a route one of them has solved is there for
+		all. Paths are kept in shards by their end state, each shard a PathCache with its
+		own lock, so pathers heading to different places rarely wait for each other.
+
+		Invalidate() discards every path, for when the graph changes. It only bumps the
+		epoch: shards are emptied when they are next used, and paths from searches begun
+		before it are dropped rather than added.
+	*/
+	template<typename Cost>
+	class BasicSharedPathCache
+	{
+	public:
+		using PathCache = BasicPathCache<Cost>;
+
+		BasicSharedPathCache(const BasicSharedPathCache&) = delete;
+		BasicSharedPathCache& operator=(const BasicSharedPathCache&) = delete;
+
+		BasicSharedPathCache(int shards, int itemsPerShard, std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+
+		void Invalidate() { ++epoch; }
+		uint32_t Epoch() const { return epoch.load(); }
+
+		/// Split 'bytes' between the shards; see MicroPather::SetPathCacheBudget().
+		void SetBudget(size_t bytes, bool autoResize);
+
+		/// The size, fill and hit rate of each shard.
+		void GetShardData(std::vector<CacheData>* data);
+
+		/// Save every shard to one file, in the form PathCache::Save() writes.
+		bool Save(const char* filename, StateIDMap* map);
+
+		/// Replace the contents with a saved cache, from Save() or PathCache::Save(); see PathCache::Load().
+		bool Load(const void* image, size_t bytes, StateIDMap* map);
+		bool Load(const char* filename, StateIDMap* map);
+
+		// The PathCache calls, each made under the lock of the shard for 'end'. Add() and
+		// AddNoSolution() drop the entries if the cache was invalidated after 'since', the
+		// Epoch() when the search that found them began.
+		bool Solve(void* start, void* end, std::vector<void*>* path, Cost* totalCost);
+		bool Solve(void* start, void* end, std::pmr::vector<void*>* path, Cost* totalCost);
+		bool Solve(void* start, void* end, PathArena::Tail* path, Cost* totalCost);
+		bool Next(void* state, void* end, void** next, Cost* remaining);
+		bool Follow(void* state, void* end, std::pmr::vector<void*>* states, std::pmr::vector<Cost>* steps);
+		bool MayHavePathsTo(void* end);
+		void Add(void* const* path, const Cost* cost, size_t count, uint32_t since);
+		void AddNoSolution(void* end, void* states[], int count, uint32_t since);
+
+		// Next() for 'count' states under one lock: the remaining cost of each, or
+		// infinity if the cache has no path from it.
+		void Next(void* const* states, int count, void* end, Cost* remaining);
+
+	private:
+		struct Shard
+		{
+			Shard(int items, std::pmr::memory_resource* resource) : cache(items, resource) {}
+
+			std::mutex mutex;
+			PathCache cache;
+			uint32_t epoch{ 0 };	// of the paths in the cache
+		};
+
+		size_t ShardIndex(void* end) const;
+
+		// Lock the shard for 'end', emptying it first if it is from an earlier epoch.
+		std::unique_lock<std::mutex> Lock(void* end, PathCache** cache);
+
+		std::pmr::deque<Shard> shards;	// a deque, as a Shard can't be moved
+		std::atomic<uint32_t> epoch{ 0 };
 	};
 
 
 	/**
 		Create a MicroPather object to solve for a best path. Detailed usage notes are
 		on the main page.
+
+		The cost type is a template parameter; MicroPather (float) is the usual choice.
 	*/
-	class MicroPather
+	template<typename Cost>
+	class BasicMicroPather
 	{
-		friend class micropather::PathNode;
-
 	public:
-		MicroPather(const MicroPather&) = delete;
-		MicroPather& operator=(const MicroPather&) = delete;
+		using Graph = BasicGraph<Cost>;
+		using StateCost = BasicStateCost<Cost>;
+		using PathNode = BasicPathNode<Cost>;
+		using NodeCost = BasicNodeCost<Cost>;
+		using PathNodePool = BasicPathNodePool<Cost>;
+		using PathCache = BasicPathCache<Cost>;
+		using SharedPathCache = BasicSharedPathCache<Cost>;
 
-		MicroPather(MicroPather&&) = delete; /// todo: allow for move semantics
-		MicroPather& operator=(MicroPather&&) = delete; /// todo: allow for move semantics
+		BasicMicroPather(const BasicMicroPather&) = delete;
+		BasicMicroPather& operator=(const BasicMicroPather&) = delete;
 
-		MicroPather(Graph* graph, unsigned allocate, unsigned typicalAdjacent, bool cache);
-		~MicroPather();
+		BasicMicroPather(BasicMicroPather&&) = delete; /// todo: allow for move semantics
+		BasicMicroPather& operator=(BasicMicroPather&&) = delete; /// todo: allow for move semantics
 
-		std::vector<void*> Solve(void* startState, void* endState);
+		/**
+			Create a pather for 'graph'. 'allocate' is how many path nodes are allocated
+			at a time, and 'typicalAdjacent' the usual number of neighbors of a state; both
+			size the internal buffers. 'cache' turns on the path cache, which holds
+			'cacheBytes' of path steps; 0 is DefaultCacheStepsPerNode steps for each node
+			in 'allocate'. A budget given here works as SetPathCacheBudget() without
+			'autoResize'.
+
+			All the memory the pather uses internally (the node pool, neighbor cache, path
+			cache and scratch buffers) comes from 'resource', which must outlive the pather.
+			The default is the default memory resource, normally new and delete.
+		*/
+		BasicMicroPather(Graph* graph, unsigned allocate, unsigned typicalAdjacent, bool cache,
+			size_t cacheBytes = 0, std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+		~BasicMicroPather();
+
+		/// Path steps the path cache holds, per node in 'allocate', when not given a size.
+		static constexpr unsigned DefaultCacheStepsPerNode = 4;
+
+		/**
+			Find the cheapest path from 'startState' to 'endState'. Returns the path, which
+			is empty if there is none (see LastStatus()). If 'totalCost' is not null it is
+			set to the cost of the path, or CostInfinity() if there is none.
+
+			With the path cache on, the search stops as soon as it is certain the best
+			path runs through a state the cache has a path from, and splices that in.
+		*/
+		std::vector<void*> Solve(void* startState, void* endState, Cost* totalCost = nullptr);
+
+		/// A path whose memory comes from a memory resource.
+		using Path = std::pmr::vector<void*>;
+
+		/**
+			As Solve() above, but writes the path to 'path' and returns LastStatus().
+			The path's storage comes from its own allocator; construct it with Resource()
+			to keep it with the pather's memory, and reuse it to avoid allocating at all.
+		*/
+		SolveStatus Solve(void* startState, void* endState, Path* path, Cost* totalCost = nullptr);
+
+		/// The memory resource the pather allocates from.
+		std::pmr::memory_resource* Resource() const { return resource; }
+
+		/**
+			As Solve(), but appends the path to 'arena' (or, if null, the pather's own
+			arena, Paths()) and returns a view of it. Once the arena has grown no new
+			path needs an allocation, and all the paths solved since the arena was last
+			cleared are in one buffer, PathArena::Data(). The status is in LastStatus();
+			the span is empty when there is no path.
+		*/
+		PathSpan SolveSpan(void* startState, void* endState, PathArena* arena = nullptr, Cost* totalCost = nullptr);
+
+		/// The arena SolveSpan() uses by default. Clear it to recycle the paths.
+		PathArena& Paths() { return pathArena; }
+
+		/**
+			Find the cheapest path from 'startState' to whichever of 'goals' is nearest, in
+			a single search that stops at the first goal reached. Returns the path, which
+			ends at that goal, and writes its index in 'goals' to 'goalIndex' if not null.
+			If no goal can be reached the path is empty and the index is -1. If the start
+			is itself a goal the path is empty and the index is that of the start.
+
+			The heuristic is Graph::LeastCostEstimateToAny(). Paths found are added to
+			the path cache, but the cache isn't consulted, since it can't tell which goal
+			is nearest.
+		*/
+		std::vector<void*> SolveToAny(void* startState, const std::vector<void*>& goals, int* goalIndex = nullptr);
+
+		/**
+			Find the cheapest path from each of 'startStates' to 'endState' in a single
+			search, for many agents heading to one place. The search runs backwards from
+			the goal until every start is reached, so the parts of the routes the starts
+			share are expanded once. It follows Graph::ReverseAdjacentCost(), which a graph
+			that isn't symmetric must implement.
+
+			'paths' is resized to match 'startStates'; paths[i] runs from startStates[i]
+			to 'endState', and is empty if there is no path or the start is the goal. If
+			'costs' is not null it is filled with the cost of each path (CostInfinity()
+			where there is none). Returns the number of starts that can reach the goal.
+		*/
+		int SolveFromMany(const std::vector<void*>& startStates, void* endState,
+			std::vector< std::vector<void*> >* paths, std::vector<Cost>* costs = nullptr);
+
+		/**
+			Fill 'field' with the flow field to 'goalState': one Dijkstra search from the
+			goal covering every state that can reach it. Like SolveFromMany() the search
+			runs backwards, following Graph::ReverseAdjacentCost(). Uses
+			Graph::BuildFlowField() if the graph implements it.
+		*/
+		void SolveFlowField(void* goalState, BasicFlowField<Cost>* field);
+
+		/**
+			Write the cost of the cheapest path from 'startState' to each of 'targets' to
+			'costs', which must have room for targets.size() values; CostInfinity<Cost>()
+			marks a target that can't be reached. A single Dijkstra search (without
+			LeastCostEstimate()) runs until every target is settled. No paths are built.
+		*/
+		void SolveDistances(void* startState, const std::vector<void*>& targets, Cost* costs);
+
+		/**
+			Fill 'table', a row-major sources.size() by targets.size() matrix, with the
+			cost from each source to each target. Sources are shared between 'threads'
+			threads (0 means one per hardware thread), each with its own MicroPather built
+			from 'allocate', 'typicalAdjacent' and 'resource', so the graph, and the
+			resource, must allow concurrent calls.
+		*/
+		static void SolveDistanceTable(Graph* graph, const std::vector<void*>& sources, const std::vector<void*>& targets,
+			Cost* table, unsigned threads = 0, unsigned allocate = 250, unsigned typicalAdjacent = 6,
+			std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+
+		/**
+			Find all the states within 'maxCost' of 'startState' (a Dijkstra search, so
+			LeastCostEstimate() is not called). Useful for threat and reachability maps.
+			'near' is cleared and filled with each state and its cost from the start,
+			in increasing order of cost; the start state comes first with a cost of 0.
+
+			The search shares the node pool and neighbor cache with Solve(), and uses
+			no heap memory once those, and 'near', have grown to the size it needs.
+		*/
+		void SolveForNearStates(void* startState, std::vector< StateCost >* near, Cost maxCost);
+
+		/**
+			Anytime search (ARA*). A first path is found with the heuristic inflated by
+			'weight', which is quick but may cost up to 'weight' times the optimum. The
+			search then lowers the weight and improves the path, reusing the nodes it has
+			already reached, until the path is optimal or 'budget' runs out. The first path
+			is always found, however long it takes.
+
+			Returns the best path found, and writes its proven suboptimality bound to
+			'bound' if not null: the path costs at most bound times the optimum, so 1 means
+			optimal. The search always uses the sorted open list. Paths are not added to
+			the path cache.
+		*/
+		std::vector<void*> SolveAnytime(void* startState, void* endState, float weight,
+			std::chrono::microseconds budget, float* bound = nullptr);
 
 		void Reset();
 
-	private:
-		void GoalReached(PathNode* node, void* start, void* end, std::vector< void* >* path);
-		void GetNodeNeighbors(PathNode* node, std::vector< NodeCost >* neighborNode);
+		/**
+			Inflate the heuristic by 'weight' (weighted A*) in Solve(), SolveToAny() and
+			SolveFromMany(). Paths cost at most 'weight' times the optimum, but a weight of
+			1.5 to 3 typically expands far fewer nodes. The default, 1, is plain A*. Use the
+			sorted open list with a weight above 1; the radix heap needs a consistent
+			heuristic and loses the bound.
+		*/
+		void SetHeuristicWeight(float weight) { heuristicWeight = weight < 1.0f ? 1.0f : weight; }
+		float GetHeuristicWeight() const { return heuristicWeight; }
+
+		/**
+			If true, estimates are kept across calls to Solve() with the same goal, so
+			repeated queries to one goal ask the graph for each state's estimate only
+			once. Estimates are always computed at most once per state per Solve().
+			Reset() discards them. Off by default.
+		*/
+		void SetRetainEstimates(bool retain) { retainEstimates = retain; }
+		bool GetRetainEstimates() const { return retainEstimates; }
+
+		PatherStats Stats() const;
+		void ClearStats() { stats = PatherStats(); pathNodePool.ClearCacheEvictions(); }
+
+		/**
+			Cap the number of path nodes, and so the memory, a search may use; 0 (the
+			default) is no limit. Nodes are allocated in blocks of 'allocate', so the cap is
+			rounded down to whole blocks, but is never less than one block. Nodes left
+			from earlier searches are freed if they are in the way. A search that still
+			doesn't fit stops with the status NodeLimit: Solve() returns an empty path,
+			and no failure is recorded in the path cache.
+		*/
+		void SetNodeLimit(unsigned maxNodes) { pathNodePool.SetMaxNodes(maxNodes); }
+
+		/**
+			Keep up to 'bytes' of path node blocks across Reset(), rather than only the first,
+			so the next large search doesn't allocate them again. Reset() is cheap either
+			way: kept nodes are re-initialized when they are reused, not by Reset(). The
+			default keeps one block.
+		*/
+		void SetPoolRetention(size_t bytes) { pathNodePool.SetRetainBytes(bytes); }
+
+		/**
+			Limit the memory used to cache each state's neighbors; 0 (the default) is no
+			limit. The cache starts at 'allocate' times 'typicalAdjacent' entries and grows
+			by that much at a time (in smaller chunks if the budget is small). When it
+			reaches the budget the oldest chunk is emptied and reused, and its states ask
+			the graph for their neighbors again. The smallest budget used is 64 entries.
+			Setting a budget empties the cache; Reset() frees all but the first chunk.
+		*/
+		void SetNeighborCacheBudget(size_t bytes) { pathNodePool.SetCacheBudget(bytes); }
+
+		/**
+			Size the path cache to 'bytes', creating it if the pather was made without one;
+			0 removes it. By default it is sized by the constructor and doesn't grow.
+			Without 'autoResize' the cache is 'bytes' from the start, and once 3/4 full takes
+			no more paths. With it, the cache keeps its current size until it is 3/4 full, then
+			doubles, up to 'bytes', as long as at least 1 search in 8 uses it; otherwise it is
+			emptied to make room for new paths. See GetCacheData() for how it is doing.
+		*/
+		void SetPathCacheBudget(size_t bytes, bool autoResize = false);
+
+		/// The size, fill and hit rate of the path cache. All zero without one.
+		void GetCacheData(CacheData* data) const;
+
+		/**
+			Use 'cache', which other pathers may share, in place of this pather's own path
+			cache; null goes back to the pather's own, if it has one. The cache must outlive
+			its use here.
+		*/
+		void SetSharedPathCache(SharedPathCache* cache) { sharedCache = cache; }
 
+		/**
+			Save the pather's own path cache to 'filename', states written as the IDs 'map'
+			gives them, so a later run can start with it (see LoadPathCache()). Returns
+			false if there is no path cache or the file can't be written.
+		*/
+		bool SavePathCache(const char* filename, StateIDMap* map) const;
+
+		/**
+			Replace the path cache with one from SavePathCache(). 'image' is the contents of
+			the file, which can be mapped into memory: it is read in place, without solving
+			anything. States 'map' no longer knows are left out, as is whatever won't fit
+			the budget at 3/4 full (see SetPathCacheBudget()). Returns false if there is
+			no path cache or 'image' isn't a saved cache of this Cost type.
+		*/
+		bool LoadPathCache(const void* image, size_t bytes, StateIDMap* map);
+		bool LoadPathCache(const char* filename, StateIDMap* map);
+		unsigned GetNodeLimit() const { return pathNodePool.GetMaxNodes(); }
+
+		/**
+			The outcome of the last search. A search stopped by the node limit may still
+			have produced a partial result: SolveForNearStates() and SolveFlowField() keep
+			the states settled so far, SolveFromMany() and SolveDistances() the starts or
+			targets reached, and SolveAnytime() the best path found.
+		*/
+		SolveStatus LastStatus() const { return status; }
+
+		/// Return all the states touched by the last call to Solve(). Useful for visualizing
+		/// what the pather is doing.
+		void StatesInPool(std::vector<void*>* stateVec)
+		{
+			stateVec->clear();
+			pathNodePool.AllStates(frame, stateVec);
+		}
+
+		/// Select the open list implementation used by subsequent calls to Solve().
+		void SetOpenList(OpenList type) { openList = type; }
+		OpenList GetOpenList() const { return openList; }
+
+		/// Select how subsequent calls to Solve() order nodes of equal total cost.
+		void SetTieBreak(TieBreak type) { tieBreak = type; }
+		TieBreak GetTieBreak() const { return tieBreak; }
+
+		/**
+			Set how many nodes from the front of the open list are passed to
+			Graph::AdjacentCostBatch() along with the node being expanded. 0 disables
+			batching. The default is 8.
+		*/
+		void SetBatchLookahead(unsigned count) { lookahead = count; }
+		unsigned GetBatchLookahead() const { return lookahead; }
+
+	private:
+		template<typename Vec>
+		Cost SolvePath(void* startState, void* endState, Vec* path);
+		template<typename Vec>
+		Cost GoalReached(PathNode* node, void* start, void* end, Vec* path);
+		void NoSolution(void* start, void* const* goals, int nGoals);
+
+		// The path cache in use: the shared one if set, else the pather's own.
+		bool HasCache() const { return sharedCache || pathCache; }
+		bool CacheMayHavePathsTo(void* end) const;
+		template<typename Vec>
+		bool CacheSolve(void* start, void* end, Vec* path, Cost* totalCost);
+		bool CacheNext(void* state, void* end, void** next, Cost* remaining);
+		void SpliceShared(void* end, PathNode** spliceNode, Cost* spliceCost);
+		bool CacheFollow(void* state, void* end);
+		void CacheAdd(void* const* path, const Cost* cost, size_t count);
+		void CacheAddNoSolution(void* end, void* states[], int count);
+		const NodeCost* GetNodeNeighbors(PathNode* node, PathNode* const* ahead = nullptr, int nAhead = 0);
+		bool BatchAdjacentCost(PathNode* node, PathNode* const* ahead, int nAhead);
+		void ConvertNeighbors(PathNode* node, const StateCost* adjacent, int count, NodeCost* nodeCost);
+		int BeginSearch(void* const* goals, int nGoals, bool reachAll, bool useEstimate);
+		PathNode* Search(void* startState, void* const* goals, int nGoals, bool reachAll = false, bool useEstimate = true, bool splice = false);
+		PathNode* Settled(void* state, PathNode* last);
+		bool RetryAfterNodeLimit();
+		bool IsGoal(void* state) const;
+		Cost Estimate(PathNode* node);
+		void EstimateNeighbors(PathNode* node, const NodeCost* neighbors, float weight);
+		void Refresh(PathNode* node);
+		static Cost Weighted(Cost estimate, float weight);
+
+		// Scratch buffers come from 'resource', except for those handed to the graph
+		// or to public calls, which take a std::vector. Lists of states are built from
+		// a StateAllocator: given the resource itself, braces would make it the one
+		// element of the list.
+		using StateAllocator = std::pmr::polymorphic_allocator<void*>;
+		std::pmr::memory_resource* resource;
 		PathNodePool pathNodePool;
 		std::vector<StateCost> stateCostVec;
-		std::vector<NodeCost> nodeCostVec;
-		std::vector<float> costVec;
+		std::pmr::vector<NodeCost> nodeCostVec{ resource };	// neighbors of a node that missed the cache
+		std::pmr::vector<Cost> costVec{ resource };
+		std::pmr::vector<void*> closedVec{ StateAllocator(resource) };
+		std::pmr::vector<void*> spliceVec{ StateAllocator(resource) };	// the cached rest of the path, for GoalReached()
+		std::pmr::vector<Cost> spliceCostVec{ resource };
+		std::pmr::vector<PathNode*> spliceNodeVec{ resource };	// closed nodes not yet looked up in a shared cache
+		std::pmr::vector<void*> spliceStateVec{ StateAllocator(resource) };
+		std::pmr::vector<Cost> spliceRemainingVec{ resource };
+		static constexpr size_t SpliceBatch = 16;	// nodes per shared cache lookup
+		PathArena pathArena{ resource };
+
+		std::pmr::vector<void*> estimateStateVec{ StateAllocator(resource) };
+		std::pmr::vector<PathNode*> estimateNodeVec{ resource };
+		std::pmr::vector<Cost> estimateVec{ resource };
+		void* estimateGoal{ nullptr };	// single goal the estimates are for, if any
+		bool estimateGoalSet{ false };
+		uint32_t estimateStamp{ 1 };	// PathNode::estimate is valid if the stamps match
+		bool retainEstimates{ false };
+		float heuristicWeight{ 1.0f };
+
+		std::pmr::vector<PathNode*> anytimeOpenVec{ resource };		// SolveAnytime(): open nodes between iterations,
+		std::pmr::vector<PathNode*> anytimeClosedVec{ resource };	// the nodes closed in this iteration,
+		std::pmr::vector<PathNode*> anytimeInconsVec{ resource };	// and closed nodes whose cost has since improved
+
+		void* const* goalStates{ nullptr };	// goals of the search in progress
+		int goalCount{ 0 };
+		std::pmr::vector<void*> goalVec{ StateAllocator(resource) };	// sorted goals, for IsGoal() with several goals
+		std::vector<StateCost> flowVec;
+
+		PatherStats stats;
+		SolveStatus status{ SolveStatus::Solved };
+		bool nodeLimitHit{ false };	// set when the pool can't supply a node
+		uint32_t poolAtStart{ 0 };	// nodes allocated when the search began
+
+		std::pmr::vector<StateCost> adjacentArray{ resource };	// for Graph::AdjacentCostArray()
+		int maxAdjacent{ 0 };
+
+		std::pmr::vector<PathNode*> aheadVec{ resource };
+		std::pmr::vector<void*> batchStateVec{ StateAllocator(resource) };
+		std::pmr::vector<int> batchCountVec{ resource };
+		std::pmr::vector<NodeCost> batchNodeCostVec{ resource };
+		unsigned lookahead{ 8 };
+		bool batchAdjacent{ true };	// cleared if the graph doesn't implement AdjacentCostBatch()
+		bool reverseAdjacent{ true };	// cleared if the graph doesn't implement ReverseAdjacentCost()
+		bool searchReverse{ false };	// the next search runs backwards from the goal
+		bool reversed{ false };			// the neighbors in the pool are from ReverseAdjacentCost()
 
 		Graph* graph;
 		unsigned int frame;
 		PathCache* pathCache;
+		int cacheItems;		// initial size of the path cache
+		SharedPathCache* sharedCache{ nullptr };
+		uint32_t cacheEpoch{ 0 };	// of the shared cache, when the search began
+		OpenList openList{ OpenList::Sorted };
+		TieBreak tieBreak{ TieBreak::Insertion };
 	};
+
+
+	/**
+		Builds flow fields on a worker thread, so a field to a new goal can be computed
+		while agents keep following the old one. Field() returns the last completed field;
+		it stays valid for as long as the caller holds the pointer, and is replaced
+		atomically when a build finishes.
+
+		The worker has its own MicroPather, so the graph must allow AdjacentCost() (or the
+		calls it replaces) to be called from the worker while other threads use it. The
+		pather's memory comes from 'resource', which only the worker thread uses.
+	*/
+	template<typename Cost>
+	class BasicFlowFieldWorker
+	{
+	public:
+		using FlowField = BasicFlowField<Cost>;
+
+		BasicFlowFieldWorker(const BasicFlowFieldWorker&) = delete;
+		BasicFlowFieldWorker& operator=(const BasicFlowFieldWorker&) = delete;
+
+		BasicFlowFieldWorker(BasicGraph<Cost>* graph, unsigned allocate, unsigned typicalAdjacent,
+			std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+		~BasicFlowFieldWorker();
+
+		/// Start building the field to 'goal'. Waits for a build in progress first.
+		void Build(void* goal);
+
+		/// Wait for the build in progress, if any.
+		void Wait();
+
+		bool Busy() const { return busy; }
+
+		/// The last completed field, or null if no build has finished.
+		std::shared_ptr<const FlowField> Field() const { return std::atomic_load(&field); }
+
+	private:
+		BasicMicroPather<Cost> pather;	// only used by the worker thread
+		std::thread thread;
+		std::shared_ptr<const FlowField> field;	// read and written with std::atomic_load/store
+		std::atomic<bool> busy{ false };
+	};
+
+
+	/// Movement rules for BasicGridGraph.
+	enum class GridMoves
+	{
+		Four,			///< East, north, west and south only.
+		Eight,			///< Diagonals are allowed whenever the target cell is passable.
+		EightNoSqueeze,	///< Diagonals are not allowed between two blocked cells.
+		EightNoCut		///< Diagonals are not allowed past any blocked cell.
+	};
+
+
+	/**
+		A ready made Graph for 2D grids of passable / blocked cells. Passability is stored
+		as packed bits, one padded row of 64 bit words per grid row, so the neighbors of a
+		cell come from three word reads and a handful of bit operations, with no bounds
+		checks. It implements the AdjacentCostArray() fast path.
+
+		States are y * width + x + 1 (so no state is null); use State() and StateToXY() to
+		convert. Straight moves cost 'straight' and diagonal moves 'diagonal'. For integer
+		costs, scale both (10 and 14, for example). The estimate is octile distance for
+		eight way movement and Manhattan distance for four.
+
+		Passability may be changed at any time, but call MicroPather::Reset() after doing so.
+	*/
+	template<typename Cost>
+	class BasicGridGraph : public BasicGraph<Cost>
+	{
+	public:
+		using StateCost = BasicStateCost<Cost>;
+
+		BasicGridGraph(int width, int height, GridMoves moves, Cost straight = 1, Cost diagonal = Cost(1.41421356));
+
+		int Width() const { return width; }
+		int Height() const { return height; }
+
+		void SetPassable(int x, int y, bool passable);
+		bool Passable(int x, int y) const;
+
+		void* State(int x, int y) const { return (void*)(intptr_t)(y * width + x + 1); }
+		void StateToXY(void* state, int* x, int* y) const;
+
+		Cost LeastCostEstimate(void* stateStart, void* stateEnd) override;
+		void AdjacentCost(void* state, std::vector< StateCost >* adjacent) override;
+		int MaxAdjacent() override { return moves == GridMoves::Four ? 4 : 8; }
+		int AdjacentCostArray(void* state, StateCost* adjacent) override;
+		bool BuildFlowField(void* goal, BasicFlowField<Cost>* field) override;
+
+	private:
+		// The passability of cells x-1, x and x+1 of row y, in bits 0, 1 and 2.
+		uint32_t Window(int x, int y) const;
+
+		int width;
+		int height;
+		int wordsPerRow;
+		GridMoves moves;
+		Cost straight;
+		Cost diagonal;
+
+		// Row y is stored at (y+1) * wordsPerRow and column x at bit x+1, so the
+		// cells just outside the grid read as blocked.
+		std::vector<uint64_t> bits;
+	};
+
+
+	using StateCost = BasicStateCost<float>;
+	using Graph = BasicGraph<float>;
+	using NodeCost = BasicNodeCost<float>;
+	using PathNode = BasicPathNode<float>;
+	using PathNodePool = BasicPathNodePool<float>;
+	using PathCache = BasicPathCache<float>;
+	using SharedPathCache = BasicSharedPathCache<float>;
+	using MicroPather = BasicMicroPather<float>;
+	using GridGraph = BasicGridGraph<float>;
+	using FlowField = BasicFlowField<float>;
+	using FlowFieldWorker = BasicFlowFieldWorker<float>;
 };
@@ -0,0 +1,1127 @@
+/*
+Copyright (c) 2000-2012 Lee Thomason (www.grinninglizard.com)
+
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any
+damages arising from the use of this software.
+
+Permission is granted to anyone to use this software for any
+purpose, including commercial applications, and to alter it and
+redistribute it freely, subject to the following restrictions:
+
+1. The origin of this software must not be misrepresented; you must
+not claim that you wrote the original software. If you use this
+software in a product, an acknowledgment in the product documentation
+would be appreciated but is not required.
+
+2. Altered source versions must be plainly marked as such, and
+must not be misrepresented as being the original software.
+
+3. This notice may not be removed or altered from any source
+distribution.
+*/
+
+// Regression test: checks each way of searching against a plain Dijkstra search
+// of the speed test map, and times warm runs with the path cache on. Prints a
+// line per feature and returns the number of failed checks.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <math.h>
+#include <float.h>
+#include <stdlib.h>
+
+#include <vector>
+#include <atomic>
+#include <memory_resource>
+#include <queue>
+#include <thread>
+#include <chrono>
+#include <functional>
+#include <algorithm>
+#include <limits>
+
+#include "micropather.h"
+using namespace micropather;
+
+typedef std::chrono::steady_clock Clock;
+
+inline double Microseconds( Clock::time_point start, Clock::time_point end )
+{
+	return std::chrono::duration<double, std::micro>( end - start ).count();
+}
+
+
+const int MAPX = 90;
+const int MAPY = 20;
+const char gMap[MAPX*MAPY+1] =
+  //"012345678901234567890123456789"
+	"     |      |                |     |      ||               |     |      |                |"
+	"     |      |----+    |      +     |      ||---+    |      +     |      |----+    |      +"
+	"---+ +---  -+      +--+--+    ---+ +---  -+|     +--+--+    ---+ +---  -+      +--+--+    "
+	"   |                     +-- +   |        ||           +-- +   |                     +-- +"
+	"        +----+  +---+                     ||  +---+                 +----+  +---+         "
+	"---+ +  +    +            |   ---+ +                    |  2---+ +  +    +            |   "
+	"   | |  +----+    +----+  +--+   | |      ||    +----+  +--+322| |  +----+    +----+  +--+"
+	"     |            |    |           |      ||    |    |   222232  |            |    |      "
+	"   | +-------+  +-+    |------------------+|  +-+    |--+  2223| +-------+  +-+    |--+   "
+	"---+                   |                  ||         |  222+---+                   |     +"
+	"     |      |          |                  ||          22233|     |      |                |"
+	"     |      |----+    ++                  ||---+3333|    22+     |      |----+    |      +"
+	"---+ +---  -+      +--+-------------------||22223+--+--+    ---+ +---  -+      +--+--+    "
+	"   |                     +-- +   |          22223333   +-- +   |                     +-- +"
+	"        +----+  +---+                 +---+|  +---+     222         +----+  +---+         "
+	"---+ +  +    +            |   ---+ +  +   +|            |222---+ +  +    +            |   "
+	"   | |  +----+    +----+  +--+   | |  +---+|  22+----+  +--+233|2|  +----+    +----+  +--+"
+	"     |            |    |           |      ||2222|    |    2223333|            |    |      "
+	"   | +-------+  +-+    |--+      | +------++  +-+    |--+      |2+-------+  +-+    |--+   "
+	"---+                   |     +---+        ||         |     +---+                   |      ";
+
+
+// The speed test dungeon, with 8 way moves. The terrain cost is paid on entering
+// a cell, so the graph isn't symmetric. States are the cell index plus one, which
+// keeps them non-null and lets a FlowField look them up densely.
+class Dungeon : public Graph, public StateIDMap
+{
+  public:
+	int Passable( int x, int y ) const
+	{
+		if ( x >= 0 && x < MAPX && y >= 0 && y < MAPY ) {
+			char c = gMap[ y*MAPX+x ];
+			if ( c == ' ' )
+				return 1;
+			else if ( c >= '1' && c <= '9' )
+				return c-'0';
+		}
+		return 0;
+	}
+
+	void* State( int x, int y ) const	{ return (void*)(intptr_t)( y*MAPX + x + 1 ); }
+	int Index( void* state ) const		{ return (int)(intptr_t)state - 1; }
+
+	float PathCost( const std::vector<void*>& path )
+	{
+		float total = 0;
+		std::vector< StateCost > adjacent;
+		for( size_t i=1; i<path.size(); ++i ) {
+			adjacent.clear();
+			AdjacentCost( path[i-1], &adjacent );
+			bool found = false;
+			for( const StateCost& sc : adjacent ) {
+				if ( sc.state == path[i] ) {
+					total += sc.cost;
+					found = true;
+					break;
+				}
+			}
+			if ( !found )
+				return -1.0f;
+		}
+		return total;
+	}
+
+	virtual float LeastCostEstimate( void* start, void* end )
+	{
+		int a = Index( start ), b = Index( end );
+		int dx = a % MAPX - b % MAPX;
+		int dy = a / MAPX - b / MAPX;
+		return (float) sqrt( (double)(dx*dx) + (double)(dy*dy) );
+	}
+
+	virtual void AdjacentCost( void* state, std::vector< StateCost > *neighbors )
+	{
+		int x = Index( state ) % MAPX, y = Index( state ) / MAPX;
+		for( int i=0; i<8; ++i ) {
+			int pass = Passable( x + dx[i], y + dy[i] );
+			if ( pass > 0 ) {
+				StateCost nodeCost = { State( x + dx[i], y + dy[i] ), cost[i] * (float)pass };
+				neighbors->push_back( nodeCost );
+			}
+		}
+	}
+
+	virtual bool ReverseAdjacentCost( void* state, std::vector< StateCost > *neighbors )
+	{
+		int x = Index( state ) % MAPX, y = Index( state ) / MAPX;
+		float pass = (float)Passable( x, y );
+		for( int i=0; i<8 && pass > 0; ++i ) {
+			if ( Passable( x + dx[i], y + dy[i] ) > 0 ) {
+				StateCost nodeCost = { State( x + dx[i], y + dy[i] ), cost[i] * pass };
+				neighbors->push_back( nodeCost );
+			}
+		}
+		return true;
+	}
+
+	virtual uint32_t StateID( void* state )	{ return (uint32_t)Index( state ); }
+	virtual void* IDState( uint32_t id )	{ return id < (uint32_t)(MAPX*MAPY) ? (void*)(intptr_t)( id + 1 ) : 0; }
+
+	// The cost from 'start' to every cell by plain Dijkstra; FLT_MAX where there is no path.
+	void Dijkstra( void* start, std::vector<float>* dist )
+	{
+		typedef std::pair<float, int> Entry;
+		std::priority_queue< Entry, std::vector<Entry>, std::greater<Entry> > open;
+		std::vector< StateCost > adjacent;
+
+		dist->assign( MAPX*MAPY, FLT_MAX );
+		(*dist)[ Index( start ) ] = 0;
+		open.push( Entry( 0.0f, Index( start ) ) );
+		while( !open.empty() ) {
+			Entry e = open.top();
+			open.pop();
+			if ( e.first > (*dist)[ e.second ] )
+				continue;
+			adjacent.clear();
+			AdjacentCost( (void*)(intptr_t)( e.second + 1 ), &adjacent );
+			for( const StateCost& sc : adjacent ) {
+				float d = e.first + sc.cost;
+				if ( d < (*dist)[ Index( sc.state ) ] ) {
+					(*dist)[ Index( sc.state ) ] = d;
+					open.push( Entry( d, Index( sc.state ) ) );
+				}
+			}
+		}
+	}
+
+	//					E  N  W   S     NE  NW  SW SE
+	const int dx[8] = { 1, 0, -1, 0,	1, -1, -1, 1 };
+	const int dy[8] = { 0, -1, 0, 1,	-1, -1, 1, 1 };
+	const float cost[8] = { 1.0f, 1.0f, 1.0f, 1.0f,
+							1.41f, 1.41f, 1.41f, 1.41f };
+};
+
+
+const int NUM_STATES = 60;
+
+Dungeon gDungeon;
+std::vector<void*> gStates;					// passable test locations
+std::vector< std::vector<float> > gDist;	// gDist[i][cell]: the Dijkstra cost from gStates[i]
+int gChecks = 0;
+int gFailed = 0;
+
+// Costs are sums of floats added in different orders.
+bool SameCost( float a, float b )
+{
+	if ( a == FLT_MAX || b == FLT_MAX )
+		return a == b;
+	return fabs( a - b ) <= 0.001f * ( b > 1.0f ? b : 1.0f );
+}
+
+float Ref( int from, void* to )
+{
+	return gDist[from][ gDungeon.Index( to ) ];
+}
+
+// Check a path from gStates[from] to 'to', and the cost the pather gave for it.
+bool CheckPath( int from, void* to, const std::vector<void*>& path, float cost )
+{
+	float ref = Ref( from, to );
+	if ( ref == FLT_MAX || gStates[from] == to )
+		return path.empty();
+	return !path.empty() && path.front() == gStates[from] && path.back() == to
+		&& SameCost( gDungeon.PathCost( path ), ref ) && SameCost( cost, ref );
+}
+
+void Report( const char* name, int runs, int bad, const char* extra = "" )
+{
+	gChecks += runs;
+	gFailed += bad;
+	printf( "%-22s runs %4d  bad %d%s%s\n", name, runs, bad, *extra ? "  " : "", extra );
+}
+
+
+// Solve() from every test location to the next, cold and then warm with the path
+// cache on, against the pather with the cache off.
+void TestSolve()
+{
+	MicroPather plain( &gDungeon, MAPX*MAPY, 8, false );
+	MicroPather cached( &gDungeon, MAPX*MAPY, 8, true );
+	cached.SetPathCacheBudget( 1 << 20 );
+
+	double time[3] = { 0 };
+	int bad = 0, runs = 0;
+	for( int pass=0; pass<3; ++pass ) {
+		MicroPather* pather = pass == 0 ? &plain : &cached;
+		for( int i=0; i<NUM_STATES; ++i ) {
+			for( int j=1; j<NUM_STATES; j+=7 ) {
+				void* to = gStates[ (i+j) % NUM_STATES ];
+				float cost = 0;
+				Clock::time_point start = Clock::now();
+				std::vector<void*> path = pather->Solve( gStates[i], to, &cost );
+				time[pass] += Microseconds( start, Clock::now() );
+				bad += CheckPath( i, to, path, cost ) ? 0 : 1;
+				++runs;
+			}
+		}
+	}
+	char buf[128];
+	snprintf( buf, sizeof(buf), "no cache %.0fus  cold %.0fus  warm %.0fus", time[0], time[1], time[2] );
+	Report( "Solve", runs, bad, buf );
+}
+
+
+// The anytime search must end optimal given the time, and within its bound when not.
+void TestAnytime()
+{
+	MicroPather pather( &gDungeon, MAPX*MAPY, 8, false );
+	int bad = 0, runs = 0;
+	for( int i=0; i<NUM_STATES; ++i ) {
+		int to = (i*13 + 5) % NUM_STATES;
+		float ref = Ref( i, gStates[to] );
+
+		float bound = 0;
+		std::vector<void*> path = pather.SolveAnytime( gStates[i], gStates[to], 3.0f, std::chrono::seconds( 1 ), &bound );
+		bad += CheckPath( i, gStates[to], path, gDungeon.PathCost( path ) ) && ( bound == 1.0f || ref == FLT_MAX ) ? 0 : 1;
+
+		path = pather.SolveAnytime( gStates[i], gStates[to], 3.0f, std::chrono::microseconds( 0 ), &bound );
+		if ( ref != FLT_MAX && i != to ) {
+			float cost = gDungeon.PathCost( path );
+			bad += !path.empty() && cost >= 0 && cost <= ref * bound * 1.001f && bound <= 3.0f ? 0 : 1;
+		}
+		runs += 2;
+	}
+	Report( "SolveAnytime", runs, bad );
+}
+
+
+void TestToAny()
+{
+	MicroPather pather( &gDungeon, MAPX*MAPY, 8, true );
+	int bad = 0, runs = 0;
+	for( int i=0; i<NUM_STATES; ++i ) {
+		std::vector<void*> goals;
+		float best = FLT_MAX;
+		for( int k=1; k<=4; ++k ) {
+			goals.push_back( gStates[ (i + k*11) % NUM_STATES ] );
+			float ref = Ref( i, goals.back() );
+			best = ref < best ? ref : best;
+		}
+		int index = -1;
+		std::vector<void*> path = pather.SolveToAny( gStates[i], goals, &index );
+		if ( best == FLT_MAX )
+			bad += path.empty() && index == -1 ? 0 : 1;
+		else
+			bad += index >= 0 && CheckPath( i, goals[index], path, best ) ? 0 : 1;
+		++runs;
+	}
+	Report( "SolveToAny", runs, bad );
+}
+
+
+// Many starts to one goal, searched backwards: needs ReverseAdjacentCost().
+void TestFromMany()
+{
+	MicroPather pather( &gDungeon, MAPX*MAPY, 8, true );
+	int bad = 0, runs = 0;
+	std::vector< std::vector<void*> > paths;
+	std::vector<float> costs;
+	for( int g=0; g<NUM_STATES; g+=6 ) {
+		int reached = pather.SolveFromMany( gStates, gStates[g], &paths, &costs );
+		int expected = 0;
+		for( int i=0; i<NUM_STATES; ++i ) {
+			bad += CheckPath( i, gStates[g], paths[i], costs[i] ) || ( i == g || gStates[i] == gStates[g] ) ? 0 : 1;
+			expected += Ref( i, gStates[g] ) != FLT_MAX ? 1 : 0;
+			++runs;
+		}
+		bad += reached == expected ? 0 : 1;
+	}
+	Report( "SolveFromMany", runs, bad );
+}
+
+
+void TestDistances()
+{
+	MicroPather pather( &gDungeon, MAPX*MAPY, 8, false );
+	std::vector<float> costs( NUM_STATES );
+	std::vector<float> table( NUM_STATES * NUM_STATES );
+	int bad = 0, runs = 0;
+
+	for( int i=0; i<NUM_STATES; i+=5 ) {
+		pather.SolveDistances( gStates[i], gStates, &costs[0] );
+		for( int j=0; j<NUM_STATES; ++j, ++runs )
+			bad += SameCost( costs[j], Ref( i, gStates[j] ) ) ? 0 : 1;
+	}
+
+	MicroPather::SolveDistanceTable( &gDungeon, gStates, gStates, &table[0], 2, MAPX*MAPY, 8 );
+	for( int i=0; i<NUM_STATES; ++i )
+		for( int j=0; j<NUM_STATES; ++j, ++runs )
+			bad += SameCost( table[ i*NUM_STATES + j ], Ref( i, gStates[j] ) ) ? 0 : 1;
+	Report( "SolveDistances/Table", runs, bad );
+}
+
+
+// The field's cost to the goal and the route it gives, from every test location.
+void TestFlowField()
+{
+	MicroPather pather( &gDungeon, MAPX*MAPY, 8, false );
+	FlowField field;
+	int bad = 0, runs = 0;
+	for( int g=0; g<NUM_STATES; g+=6 ) {
+		pather.SolveFlowField( gStates[g], &field );
+		for( int i=0; i<NUM_STATES; ++i, ++runs ) {
+			std::vector<void*> path;
+			void* next = 0;
+			float cost = field.Next( gStates[i], &next );
+			if ( cost != FLT_MAX && gStates[i] != gStates[g] ) {
+				path.push_back( gStates[i] );
+				for( ; next && (int)path.size() <= MAPX*MAPY; field.Next( next, &next ) )
+					path.push_back( next );
+			}
+			bad += CheckPath( i, gStates[g], path, cost ) || gStates[i] == gStates[g] ? 0 : 1;
+		}
+	}
+	Report( "SolveFlowField", runs, bad );
+}
+
+
+// Four threads, each with its own pather, sharing one path cache.
+void TestSharedCache()
+{
+	SharedPathCache cache( 4, 1024 );
+	const int THREADS = 4;
+	int bad[THREADS] = { 0 };
+	int runs = 0;
+
+	std::vector<std::thread> threads;
+	for( int t=0; t<THREADS; ++t ) {
+		threads.emplace_back( [&cache, &bad, t]() {
+			MicroPather pather( &gDungeon, MAPX*MAPY, 8, false );
+			pather.SetSharedPathCache( &cache );
+			for( int pass=0; pass<2; ++pass ) {
+				for( int i=0; i<NUM_STATES; ++i ) {
+					void* to = gStates[ (i*7 + t) % NUM_STATES ];
+					float cost = 0;
+					std::vector<void*> path = pather.Solve( gStates[i], to, &cost );
+					bad[t] += CheckPath( i, to, path, cost ) ? 0 : 1;
+				}
+			}
+		} );
+		runs += 2 * NUM_STATES;
+	}
+	for( std::thread& thread : threads )
+		thread.join();
+
+	std::vector<CacheData> data;
+	cache.GetShardData( &data );
+	int hits = 0, failed = 0;
+	for( int t=0; t<THREADS; ++t )
+		failed += bad[t];
+	for( const CacheData& d : data ) {
+		hits += d.hit;
+		failed += d.memoryFraction > 0.75f ? 1 : 0;	// each shard stays under its load factor
+	}
+	failed += hits > 0 ? 0 : 1;
+
+	char buf[64];
+	snprintf( buf, sizeof(buf), "hits %d", hits );
+	Report( "SharedPathCache", runs, failed, buf );
+}
+
+
+// A cache saved by one pather and loaded by another answers the same, without
+// asking the graph for the paths it holds.
+void TestSaveLoad()
+{
+	const char* filename = "regress_cache.bin";
+	MicroPather saver( &gDungeon, MAPX*MAPY, 8, true );
+	saver.SetPathCacheBudget( 1 << 20 );
+	for( int i=0; i<NUM_STATES; ++i )
+		saver.Solve( gStates[i], gStates[ (i+1) % NUM_STATES ] );
+
+	int bad = saver.SavePathCache( filename, &gDungeon ) ? 0 : 1;
+	MicroPather loader( &gDungeon, MAPX*MAPY, 8, true );
+	loader.SetPathCacheBudget( 1 << 20 );
+	bad += loader.LoadPathCache( filename, &gDungeon ) ? 0 : 1;
+
+	int runs = 2;
+	double time = 0;
+	for( int i=0; i<NUM_STATES; ++i, ++runs ) {
+		void* to = gStates[ (i+1) % NUM_STATES ];
+		float cost = 0;
+		Clock::time_point start = Clock::now();
+		std::vector<void*> path = loader.Solve( gStates[i], to, &cost );
+		time += Microseconds( start, Clock::now() );
+		bad += CheckPath( i, to, path, cost ) ? 0 : 1;
+	}
+	remove( filename );
+
+	char buf[64];
+	snprintf( buf, sizeof(buf), "loaded %.0fus", time );
+	Report( "Save/LoadPathCache", runs, bad, buf );
+}
+
+
+// A search that runs out of nodes says so; nothing it leaves behind may spoil
+// the searches after the limit is lifted.
+void TestNodeLimit()
+{
+	MicroPather pather( &gDungeon, 64, 8, true );
+	pather.SetNodeLimit( 128 );
+	int bad = 0, runs = 0, limited = 0;
+	for( int pass=0; pass<2; ++pass ) {
+		for( int i=0; i<NUM_STATES; ++i, ++runs ) {
+			void* to = gStates[ (i*17 + 3) % NUM_STATES ];
+			float cost = 0;
+			std::vector<void*> path = pather.Solve( gStates[i], to, &cost );
+			if ( pather.LastStatus() == SolveStatus::NodeLimit ) {
+				bad += path.empty() && pass == 0 ? 0 : 1;
+				++limited;
+			}
+			else {
+				bad += CheckPath( i, to, path, cost ) ? 0 : 1;
+			}
+		}
+		pather.SetNodeLimit( 0 );
+	}
+	bad += limited > 0 ? 0 : 1;
+
+	char buf[64];
+	snprintf( buf, sizeof(buf), "limited %d", limited );
+	Report( "SetNodeLimit", runs, bad, buf );
+}
+
+
+// The dungeon with another cost type. Integer costs are the float ones times 100.
+template<typename Cost>
+class CostDungeon : public BasicGraph<Cost>
+{
+  public:
+	typedef BasicStateCost<Cost> StateCost;
+
+	static Cost Convert( float cost )
+	{
+		return std::numeric_limits<Cost>::is_integer ? (Cost)lround( cost * 100.0 ) : (Cost)cost;
+	}
+
+	// The octile distance: a consistent estimate, as the radix open list wants.
+	virtual Cost LeastCostEstimate( void* start, void* end )
+	{
+		int a = gDungeon.Index( start ), b = gDungeon.Index( end );
+		int dx = abs( a % MAPX - b % MAPX );
+		int dy = abs( a / MAPX - b / MAPX );
+		int diagonal = dx < dy ? dx : dy;
+		return Convert( 1.41f ) * (Cost)diagonal + Convert( 1.0f ) * (Cost)( dx + dy - 2*diagonal );
+	}
+
+	virtual void AdjacentCost( void* state, std::vector< StateCost > *neighbors )
+	{
+		std::vector< ::StateCost > adjacent;
+		gDungeon.AdjacentCost( state, &adjacent );
+		for( const ::StateCost& sc : adjacent ) {
+			StateCost nodeCost = { sc.state, Convert( sc.cost ) };
+			neighbors->push_back( nodeCost );
+		}
+	}
+
+	Cost PathCost( const std::vector<void*>& path )
+	{
+		Cost total = 0;
+		std::vector< StateCost > adjacent;
+		for( size_t i=1; i<path.size(); ++i ) {
+			adjacent.clear();
+			AdjacentCost( path[i-1], &adjacent );
+			for( const StateCost& sc : adjacent ) {
+				if ( sc.state == path[i] )
+					total += sc.cost;
+			}
+		}
+		return total;
+	}
+
+	// As Dungeon::Dijkstra(), in this cost type.
+	void Dijkstra( void* start, std::vector<Cost>* dist )
+	{
+		typedef std::pair<Cost, int> Entry;
+		std::priority_queue< Entry, std::vector<Entry>, std::greater<Entry> > open;
+		std::vector< StateCost > adjacent;
+
+		dist->assign( MAPX*MAPY, CostInfinity<Cost>() );
+		(*dist)[ gDungeon.Index( start ) ] = 0;
+		open.push( Entry( 0, gDungeon.Index( start ) ) );
+		while( !open.empty() ) {
+			Entry e = open.top();
+			open.pop();
+			if ( e.first > (*dist)[ e.second ] )
+				continue;
+			adjacent.clear();
+			AdjacentCost( (void*)(intptr_t)( e.second + 1 ), &adjacent );
+			for( const StateCost& sc : adjacent ) {
+				Cost d = e.first + sc.cost;
+				if ( d < (*dist)[ gDungeon.Index( sc.state ) ] ) {
+					(*dist)[ gDungeon.Index( sc.state ) ] = d;
+					open.push( Entry( d, gDungeon.Index( sc.state ) ) );
+				}
+			}
+		}
+	}
+};
+
+
+// Solve() with a double or integer cost finds paths of the Dijkstra cost in that
+// type: exactly for integers, to rounding for doubles.
+template<typename Cost>
+void TestCostType( const char* name, OpenList openList )
+{
+	CostDungeon<Cost> graph;
+	BasicMicroPather<Cost> pather( &graph, MAPX*MAPY, 8, true );
+	pather.SetOpenList( openList );
+
+	int bad = 0, runs = 0;
+	double time = 0;
+	std::vector<Cost> dist;
+	for( int i=0; i<NUM_STATES; ++i ) {
+		graph.Dijkstra( gStates[i], &dist );
+		for( int j=1; j<NUM_STATES; j+=9, ++runs ) {
+			void* to = gStates[ (i+j) % NUM_STATES ];
+			Cost ref = dist[ gDungeon.Index( to ) ];
+			Cost cost = 0;
+			Clock::time_point start = Clock::now();
+			std::vector<void*> path = pather.Solve( gStates[i], to, &cost );
+			time += Microseconds( start, Clock::now() );
+			if ( ref == CostInfinity<Cost>() || to == gStates[i] ) {
+				bad += path.empty() ? 0 : 1;
+				continue;
+			}
+			Cost slack = std::numeric_limits<Cost>::is_integer ? 0 : (Cost)( ref * 1e-9 );
+			Cost walked = graph.PathCost( path );
+			bad += !path.empty() && path.back() == to && cost <= ref + slack && cost + slack >= ref
+				&& walked <= ref + slack && walked + slack >= ref ? 0 : 1;
+		}
+	}
+	char buf[64];
+	snprintf( buf, sizeof(buf), "%.0fus", time );
+	Report( name, runs, bad, buf );
+}
+
+
+// The dungeon answering neighbor queries in batches, counting them.
+class BatchDungeon : public Graph
+{
+  public:
+	int singleCalls = 0;
+	int batchCalls = 0;
+	int batchStates = 0;
+
+	virtual float LeastCostEstimate( void* start, void* end )
+	{
+		return gDungeon.LeastCostEstimate( start, end );
+	}
+
+	virtual void AdjacentCost( void* state, std::vector< StateCost > *neighbors )
+	{
+		++singleCalls;
+		gDungeon.AdjacentCost( state, neighbors );
+	}
+
+	virtual bool AdjacentCostBatch( void* const* states, int nStates, std::vector< StateCost >* adjacent, int* counts )
+	{
+		++batchCalls;
+		batchStates += nStates;
+		for( int i=0; i<nStates; ++i ) {
+			size_t before = adjacent->size();
+			gDungeon.AdjacentCost( states[i], adjacent );
+			counts[i] = (int)( adjacent->size() - before );
+		}
+		return true;
+	}
+};
+
+
+// Neighbors fetched in batches, a few open nodes ahead, give the same paths. A node
+// with no unknown nodes ahead is asked about alone, but most should be batched.
+void TestBatch()
+{
+	BatchDungeon graph;
+	MicroPather pather( &graph, MAPX*MAPY, 8, false );
+	int bad = 0, runs = 0;
+	for( int i=0; i<NUM_STATES; ++i, ++runs ) {
+		void* to = gStates[ (i*19 + 4) % NUM_STATES ];
+		float cost = 0;
+		std::vector<void*> path = pather.Solve( gStates[i], to, &cost );
+		bad += CheckPath( i, to, path, cost ) ? 0 : 1;
+	}
+	bad += graph.batchStates > graph.batchCalls && graph.batchStates > graph.singleCalls ? 0 : 1;
+
+	char buf[64];
+	snprintf( buf, sizeof(buf), "batches %d of %.1f states, single %d", graph.batchCalls,
+			  graph.batchCalls ? double(graph.batchStates) / graph.batchCalls : 0.0, graph.singleCalls );
+	Report( "AdjacentCostBatch", runs + 1, bad, buf );
+}
+
+
+// The neighbors of (x, y) by GridGraph's rules, worked out one cell at a time.
+void GridNeighbors( const GridGraph& grid, GridMoves moves, int x, int y, std::vector< StateCost >* neighbors )
+{
+	static const int dx[8] = { 1, 0, -1, 0, 1, -1, -1, 1 };
+	static const int dy[8] = { 0, -1, 0, 1, -1, -1, 1, 1 };
+	neighbors->clear();
+	for( int i=0; i<(moves == GridMoves::Four ? 4 : 8); ++i ) {
+		int nx = x + dx[i], ny = y + dy[i];
+		if ( nx < 0 || ny < 0 || nx >= grid.Width() || ny >= grid.Height() || !grid.Passable( nx, ny ) )
+			continue;
+		if ( i >= 4 ) {
+			bool side0 = grid.Passable( nx, y ), side1 = grid.Passable( x, ny );
+			if ( moves == GridMoves::EightNoSqueeze && !side0 && !side1 )
+				continue;
+			if ( moves == GridMoves::EightNoCut && ( !side0 || !side1 ) )
+				continue;
+		}
+		StateCost nodeCost = { grid.State( nx, ny ), i < 4 ? 1.0f : 1.41421356f };
+		neighbors->push_back( nodeCost );
+	}
+	std::sort( neighbors->begin(), neighbors->end(),
+			   []( const StateCost& a, const StateCost& b ) { return a.state < b.state; } );
+}
+
+
+// GridGraph's bit twiddled neighbors match the rules for every cell and move set,
+// through both AdjacentCost() and AdjacentCostArray(), and its paths match a
+// Dijkstra search over the rules.
+void TestGridGraph()
+{
+	const int W = 70, H = 45;
+	const GridMoves allMoves[4] = { GridMoves::Four, GridMoves::Eight, GridMoves::EightNoSqueeze, GridMoves::EightNoCut };
+	int bad = 0, runs = 0;
+
+	for( GridMoves moves : allMoves ) {
+		GridGraph grid( W, H, moves );
+		srand( 7 );
+		for( int y=0; y<H; ++y )
+			for( int x=0; x<W; ++x )
+				grid.SetPassable( x, y, rand() % 10 < 7 );
+
+		std::vector< StateCost > expected, adjacent;
+		StateCost array[8];
+		for( int y=0; y<H; ++y ) {
+			for( int x=0; x<W; ++x ) {
+				if ( !grid.Passable( x, y ) )
+					continue;
+				GridNeighbors( grid, moves, x, y, &expected );
+				adjacent.clear();
+				grid.AdjacentCost( grid.State( x, y ), &adjacent );
+				int count = grid.AdjacentCostArray( grid.State( x, y ), array );
+				std::vector< StateCost > fromArray( array, array + count );
+				for( std::vector< StateCost >* list : { &adjacent, &fromArray } ) {
+					std::sort( list->begin(), list->end(),
+							   []( const StateCost& a, const StateCost& b ) { return a.state < b.state; } );
+					bool same = list->size() == expected.size();
+					for( size_t i=0; same && i<expected.size(); ++i )
+						same = (*list)[i].state == expected[i].state && SameCost( (*list)[i].cost, expected[i].cost );
+					bad += same ? 0 : 1;
+					++runs;
+				}
+			}
+		}
+
+		// Dijkstra over the rules, from a few passable cells to every cell.
+		MicroPather pather( &grid, W*H, 8, false );
+		for( int q=0; q<8; ++q ) {
+			int start = ( q * 397 ) % ( W*H );
+			while( !grid.Passable( start % W, start / W ) )
+				start = ( start + 1 ) % ( W*H );
+
+			typedef std::pair<float, int> Entry;
+			std::priority_queue< Entry, std::vector<Entry>, std::greater<Entry> > open;
+			std::vector<float> dist( W*H, FLT_MAX );
+			dist[start] = 0;
+			open.push( Entry( 0.0f, start ) );
+			while( !open.empty() ) {
+				Entry e = open.top();
+				open.pop();
+				if ( e.first > dist[ e.second ] )
+					continue;
+				GridNeighbors( grid, moves, e.second % W, e.second / W, &expected );
+				for( const StateCost& sc : expected ) {
+					int x, y;
+					grid.StateToXY( sc.state, &x, &y );
+					if ( e.first + sc.cost < dist[ y*W + x ] ) {
+						dist[ y*W + x ] = e.first + sc.cost;
+						open.push( Entry( dist[ y*W + x ], y*W + x ) );
+					}
+				}
+			}
+
+			for( int t=0; t<10; ++t, ++runs ) {
+				int end = ( start + 1 + t * 311 ) % ( W*H );
+				if ( !grid.Passable( end % W, end / W ) )
+					continue;
+				float cost = 0;
+				std::vector<void*> path = pather.Solve( grid.State( start % W, start / W ), grid.State( end % W, end / W ), &cost );
+				if ( dist[end] == FLT_MAX )
+					bad += path.empty() ? 0 : 1;
+				else
+					bad += !path.empty() && SameCost( cost, dist[end] ) ? 0 : 1;
+			}
+		}
+	}
+	Report( "GridGraph", runs, bad );
+}
+
+
+// Leave a pattern in the stack below the caller, as uninitialized locals would
+// pick up.
+void DirtyStack()
+{
+	volatile unsigned char junk[4096];
+	for( size_t i=0; i<sizeof(junk); ++i )
+		junk[i] = 0xab;
+}
+
+
+// A saved cache of doubles has 4 bytes of padding after each item's 'next'; they
+// must be zero, so the same cache always saves to the same file.
+void TestSaveBytes()
+{
+	const char* filename = "regress_double.bin";
+	CostDungeon<double> graph;
+	BasicMicroPather<double> pather( &graph, MAPX*MAPY, 8, true );
+	for( int i=0; i<NUM_STATES; ++i )
+		pather.Solve( gStates[i], gStates[ (i+1) % NUM_STATES ] );
+
+	DirtyStack();
+	int bad = pather.SavePathCache( filename, &gDungeon ) ? 0 : 1;
+	int runs = 1;
+
+	std::vector<unsigned char> bytes;
+	FILE* fp = fopen( filename, "rb" );
+	for( int c = fp ? getc( fp ) : EOF; c != EOF; c = getc( fp ) )
+		bytes.push_back( (unsigned char)c );
+	if ( fp )
+		fclose( fp );
+	remove( filename );
+
+	// A 16 byte header, then items of start, end, next, padding and cost.
+	const size_t HEADER = 16, ITEM = 24;
+	bad += bytes.size() > HEADER && ( bytes.size() - HEADER ) % ITEM == 0 ? 0 : 1;
+	for( size_t at = HEADER; at + ITEM <= bytes.size(); at += ITEM, ++runs ) {
+		bad += bytes[at+12] == 0 && bytes[at+13] == 0 && bytes[at+14] == 0 && bytes[at+15] == 0 ? 0 : 1;
+	}
+	Report( "SavePathCache bytes", runs, bad );
+}
+
+
+// A grid that lists each cell's neighbors in the opposite order.
+class ReversedGrid : public BasicGridGraph<uint32_t>
+{
+  public:
+	ReversedGrid( int width, int height ) : BasicGridGraph<uint32_t>( width, height, GridMoves::Eight, 10, 14 ) {}
+
+	virtual int AdjacentCostArray( void* state, BasicStateCost<uint32_t>* adjacent )
+	{
+		int count = BasicGridGraph<uint32_t>::AdjacentCostArray( state, adjacent );
+		std::reverse( adjacent, adjacent + count );
+		return count;
+	}
+};
+
+
+// An open grid with a wall across it. Most of it is one plateau of equal total cost.
+template<typename Grid>
+void BuildPlateau( Grid* grid )
+{
+	for( int y=0; y<grid->Height(); ++y )
+		for( int x=0; x<grid->Width(); ++x )
+			grid->SetPassable( x, y, x != grid->Width()/2 || y == grid->Height()-1 );
+}
+
+
+// The deterministic tie break gives the same path whatever order the neighbors
+// come in, with either open list, at the optimal cost and with no more expansions.
+void TestTieBreak()
+{
+	const int SIZE = 120;
+	BasicGridGraph<uint32_t> grid( SIZE, SIZE, GridMoves::Eight, 10, 14 );
+	ReversedGrid reversed( SIZE, SIZE );
+	BuildPlateau( &grid );
+	BuildPlateau( &reversed );
+
+	int bad = 0, runs = 0;
+	unsigned expanded[2] = { 0 };
+	for( int list=0; list<2; ++list ) {
+		OpenList openList = list ? OpenList::Radix : OpenList::Sorted;
+		for( int q=0; q<20; ++q, ++runs ) {
+			void* start = grid.State( (q*37) % SIZE, (q*11) % SIZE );
+			void* end = grid.State( SIZE-1 - (q*53) % (SIZE/2), (q*29) % SIZE );
+
+			BasicMicroPather<uint32_t> plain( &grid, SIZE*SIZE, 8, false );
+			uint32_t plainCost = 0;
+			plain.Solve( start, end, &plainCost );
+			if ( list == 0 )
+				expanded[0] += plain.Stats().neighborMisses;
+
+			uint32_t cost[2] = { 0 };
+			std::vector<void*> path[2];
+			for( int g=0; g<2; ++g ) {
+				BasicMicroPather<uint32_t> pather( g ? (BasicGraph<uint32_t>*)&reversed : &grid, SIZE*SIZE, 8, false );
+				pather.SetOpenList( openList );
+				pather.SetTieBreak( TieBreak::Deterministic );
+				path[g] = pather.Solve( start, end, &cost[g] );
+				if ( g == 0 && list == 0 )
+					expanded[1] += pather.Stats().neighborMisses;
+			}
+			bad += path[0] == path[1] && !path[0].empty() && cost[0] == plainCost && cost[1] == plainCost ? 0 : 1;
+		}
+	}
+	bad += expanded[1] <= expanded[0] ? 0 : 1;
+	++runs;
+
+	char buf[64];
+	snprintf( buf, sizeof(buf), "expanded %u (insertion %u)", expanded[1], expanded[0] );
+	Report( "TieBreak", runs, bad, buf );
+}
+
+
+// Counts the allocations made through it, which may come from any thread.
+class CountingResource : public std::pmr::memory_resource
+{
+  public:
+	std::atomic<int> allocations{ 0 };
+
+  private:
+	virtual void* do_allocate( size_t bytes, size_t alignment )
+	{
+		++allocations;
+		return std::pmr::new_delete_resource()->allocate( bytes, alignment );
+	}
+	virtual void do_deallocate( void* p, size_t bytes, size_t alignment )
+	{
+		std::pmr::new_delete_resource()->deallocate( p, bytes, alignment );
+	}
+	virtual bool do_is_equal( const std::pmr::memory_resource& other ) const noexcept
+	{
+		return this == &other;
+	}
+};
+
+
+// Everything the solvers allocate internally comes from the resource they are
+// given; none of it from the default resource.
+void TestResource()
+{
+	CountingResource given, fallback;
+	std::pmr::memory_resource* oldDefault = std::pmr::set_default_resource( &fallback );
+	int bad = 0, runs = 0;
+	{
+		SharedPathCache shared( 4, 256, &given );
+		MicroPather pather( &gDungeon, MAPX*MAPY, 8, true, 0, &given );
+		MicroPather sharing( &gDungeon, MAPX*MAPY, 8, false, 0, &given );
+		sharing.SetSharedPathCache( &shared );
+
+		std::vector< std::vector<void*> > paths;
+		std::vector<float> costs( NUM_STATES );
+		std::vector< StateCost > near;
+		FlowField field;
+		for( int i=0; i<NUM_STATES; ++i, runs += 2 ) {
+			void* to = gStates[ (i*31 + 3) % NUM_STATES ];
+			float cost = 0;
+			std::vector<void*> path = pather.Solve( gStates[i], to, &cost );
+			bad += CheckPath( i, to, path, cost ) ? 0 : 1;
+			path = sharing.Solve( gStates[i], to, &cost );
+			bad += CheckPath( i, to, path, cost ) ? 0 : 1;
+			pather.SolveSpan( gStates[i], to );
+		}
+		pather.SolveToAny( gStates[0], gStates );
+		pather.SolveFromMany( gStates, gStates[1], &paths );
+		pather.SolveFlowField( gStates[2], &field );
+		pather.SolveDistances( gStates[3], gStates, &costs[0] );
+		pather.SolveForNearStates( gStates[4], &near, 20.0f );
+		pather.SolveAnytime( gStates[5], gStates[6], 3.0f, std::chrono::milliseconds( 10 ) );
+		MicroPather::Path pmrPath( pather.Resource() );
+		pather.Solve( gStates[7], gStates[8], &pmrPath );
+
+		std::vector<float> table( 4 * NUM_STATES );
+		std::vector<void*> sources( gStates.begin(), gStates.begin() + 4 );
+		MicroPather::SolveDistanceTable( &gDungeon, sources, gStates, &table[0], 2, MAPX*MAPY, 8, &given );
+		for( int i=0; i<4; ++i )
+			for( int j=0; j<NUM_STATES; ++j, ++runs )
+				bad += SameCost( table[ i*NUM_STATES + j ], Ref( i, gStates[j] ) ) ? 0 : 1;
+
+		FlowFieldWorker worker( &gDungeon, MAPX*MAPY, 8, &given );
+		worker.Build( gStates[9] );
+		worker.Wait();
+		bad += worker.Field() && worker.Field()->Size() > 0 ? 0 : 1;
+	}
+	std::pmr::set_default_resource( oldDefault );
+	bad += given.allocations > 0 && fallback.allocations == 0 ? 0 : 1;
+
+	char buf[64];
+	snprintf( buf, sizeof(buf), "given %d  default %d", given.allocations.load(), fallback.allocations.load() );
+	Report( "memory_resource", runs + 2, bad, buf );
+}
+
+
+// SolveForNearStates() returns exactly the states Dijkstra puts within the radius,
+// at the same costs, cheapest first. Once warm it allocates nothing.
+void TestNearStates()
+{
+	CountingResource resource;
+	MicroPather pather( &gDungeon, MAPX*MAPY, 8, false, 0, &resource );
+	std::vector< StateCost > near;
+	int bad = 0, runs = 0;
+
+	for( int i=0; i<NUM_STATES; i+=3 ) {
+		const float radius = 4.0f + (float)( i % 7 ) * 3.0f;
+		pather.SolveForNearStates( gStates[i], &near, radius );
+		int allocations = resource.allocations;
+		pather.SolveForNearStates( gStates[i], &near, radius );
+		bad += resource.allocations == allocations ? 0 : 1;
+
+		std::vector<bool> found( MAPX*MAPY, false );
+		bad += !near.empty() && near[0].state == gStates[i] && near[0].cost == 0 ? 0 : 1;
+		for( size_t k=0; k<near.size(); ++k ) {
+			float ref = Ref( i, near[k].state );
+			bad += SameCost( near[k].cost, ref ) && near[k].cost <= radius
+				&& ( k == 0 || near[k-1].cost <= near[k].cost ) ? 0 : 1;
+			found[ gDungeon.Index( near[k].state ) ] = true;
+		}
+		// Every cell clearly inside the radius is there; none clearly outside.
+		for( int cell=0; cell<MAPX*MAPY; ++cell ) {
+			float ref = gDist[i][cell];
+			if ( fabs( ref - radius ) > 0.01f )
+				bad += found[cell] == ( ref < radius ) ? 0 : 1;
+		}
+		runs += 2;
+	}
+	Report( "SolveForNearStates", runs, bad );
+}
+
+
+// SolveSpan() appends each path to the arena, back to back from the start of an
+// empty one, and gives the same paths as Solve().
+void TestSpan()
+{
+	MicroPather plain( &gDungeon, MAPX*MAPY, 8, false );
+	MicroPather pather( &gDungeon, MAPX*MAPY, 8, true );
+	int bad = pather.Paths().Size() == 0 ? 0 : 1;
+	int runs = 1;
+
+	std::vector<PathSpan> spans;
+	size_t offset = 0;
+	for( int i=0; i<NUM_STATES; ++i, ++runs ) {
+		void* to = gStates[ (i*29 + 7) % NUM_STATES ];
+		float cost = 0;
+		PathSpan span = pather.SolveSpan( gStates[i], to, 0, &cost );
+		std::vector<void*> path( span.begin(), span.end() );
+		bad += CheckPath( i, to, path, cost ) && span.Offset() == offset ? 0 : 1;
+		offset += span.size();
+		spans.push_back( span );
+	}
+	bad += pather.Paths().Size() == offset ? 0 : 1;
+
+	// The spans are still the paths once the arena has stopped growing.
+	for( int i=0; i<NUM_STATES; ++i, ++runs ) {
+		std::vector<void*> path = plain.Solve( gStates[i], gStates[ (i*29 + 7) % NUM_STATES ] );
+		bad += path == std::vector<void*>( spans[i].begin(), spans[i].end() ) ? 0 : 1;
+	}
+
+	pather.Paths().Clear();
+	PathSpan span = pather.SolveSpan( gStates[0], gStates[1] );
+	bad += span.Offset() == 0 && pather.Paths().Size() == span.size() ? 0 : 1;
+	Report( "SolveSpan", runs + 1, bad );
+}
+
+
+// A neighbor cache far smaller than the map must evict, and still find the same paths.
+void TestNeighborBudget()
+{
+	MicroPather pather( &gDungeon, MAPX*MAPY, 8, false );
+	pather.SetNeighborCacheBudget( 4096 );
+	int bad = 0, runs = 0;
+	for( int i=0; i<NUM_STATES; ++i, ++runs ) {
+		void* to = gStates[ (i*23 + 1) % NUM_STATES ];
+		float cost = 0;
+		std::vector<void*> path = pather.Solve( gStates[i], to, &cost );
+		bad += CheckPath( i, to, path, cost ) ? 0 : 1;
+	}
+	PatherStats stats = pather.Stats();
+	bad += stats.neighborEvictions > 0 ? 0 : 1;
+
+	char buf[64];
+	snprintf( buf, sizeof(buf), "evictions %u", stats.neighborEvictions );
+	Report( "SetNeighborCacheBudget", runs, bad, buf );
+}
+
+
+// The path cache is sized by the constructor: by default from 'allocate', or to a
+// byte budget, which it then keeps to as SetPathCacheBudget() would, even when
+// loading a bigger saved cache.
+void TestCacheSize()
+{
+	const int itemBytes = sizeof( PathCache::Item );
+	const int budget = 512 * itemBytes;
+	const char* filename = "regress_size.bin";
+	MicroPather plain( &gDungeon, MAPX*MAPY, 8, true );
+	MicroPather sized( &gDungeon, MAPX*MAPY, 8, true, budget );
+	CacheData data;
+	plain.GetCacheData( &data );
+	int bad = data.nBytesAllocated == MAPX*MAPY * (int)MicroPather::DefaultCacheStepsPerNode * itemBytes ? 0 : 1;
+	sized.GetCacheData( &data );
+	bad += data.nBytesAllocated == budget ? 0 : 1;
+
+	int runs = 2;
+	for( int i=0; i<NUM_STATES; ++i, ++runs ) {
+		void* to = gStates[ (i*7 + 3) % NUM_STATES ];
+		float cost = 0;
+		plain.Solve( gStates[i], to );
+		std::vector<void*> path = sized.Solve( gStates[i], to, &cost );
+		bad += CheckPath( i, to, path, cost ) ? 0 : 1;
+	}
+	bad += plain.SavePathCache( filename, &gDungeon ) ? 0 : 1;
+	bad += sized.LoadPathCache( filename, &gDungeon ) ? 0 : 1;
+	remove( filename );
+	runs += 2;
+	for( int i=0; i<NUM_STATES; ++i, ++runs ) {
+		void* to = gStates[ (i*7 + 3) % NUM_STATES ];
+		float cost = 0;
+		std::vector<void*> path = sized.Solve( gStates[i], to, &cost );
+		bad += CheckPath( i, to, path, cost ) ? 0 : 1;
+	}
+	sized.GetCacheData( &data );
+	bad += data.nBytesAllocated == budget ? 0 : 1;
+	runs += 1;
+
+	char buf[64];
+	snprintf( buf, sizeof(buf), "used %d of %d bytes", data.nBytesUsed, data.nBytesAllocated );
+	Report( "Cache size", runs, bad, buf );
+}
+
+
+int main( int argc, const char* argv[] )
+{
+	// Spread the test locations over the map, moving each to a passable cell.
+	for( int i=0; i<NUM_STATES; ++i ) {
+		int index = (MAPX*MAPY) * i / NUM_STATES;
+		while( !gDungeon.Passable( index % MAPX, index / MAPX ) )
+			++index;
+		gStates.push_back( gDungeon.State( index % MAPX, index / MAPX ) );
+	}
+	gDist.resize( NUM_STATES );
+	for( int i=0; i<NUM_STATES; ++i )
+		gDungeon.Dijkstra( gStates[i], &gDist[i] );
+
+	TestSolve();
+	TestAnytime();
+	TestToAny();
+	TestFromMany();
+	TestDistances();
+	TestFlowField();
+	TestSharedCache();
+	TestSaveLoad();
+	TestNodeLimit();
+	TestNeighborBudget();
+	TestCacheSize();
+	TestSpan();
+	TestResource();
+	TestTieBreak();
+	TestCostType<double>( "Cost double", OpenList::Sorted );
+	TestCostType<uint32_t>( "Cost uint32_t", OpenList::Sorted );
+	TestCostType<uint32_t>( "Radix uint32_t", OpenList::Radix );
+	TestCostType<double>( "Radix double", OpenList::Radix );
+	TestSaveBytes();
+	TestBatch();
+	TestGridGraph();
+	TestNearStates();
+
+	printf( "Regression: %d checks, %d failed\n", gChecks, gFailed );
+	return gFailed;
+}
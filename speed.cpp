@@ -28,6 +28,8 @@ distribution.
 #include <math.h>
 #include <time.h>
 #include <limits.h>
+#include <float.h>
+#include <stdlib.h>
 
 #include <vector>
 #include <chrono>
@@ -97,12 +99,12 @@ const char gMap[MAPX*MAPY+1] =
 class Dungeon : public Graph
 {
   public:
-	MPVector<void*> path;
+	std::vector<void*> path;
 	MicroPather* aStar;
 	int maxDir;
 
 	Dungeon() {
-		aStar = new MicroPather( this, MAPX*MAPY, 6 );
+		aStar = new MicroPather( this, MAPX*MAPY, 6, true );
 		maxDir = 4;
 	}
 
@@ -120,9 +122,7 @@ class Dungeon : public Graph
 			if ( c == ' ' )
 				return 1;
 			else if ( c >= '1' && c <= '9' ) {
-				int val = c-'0';
-				MPASSERT( val > 0 );
-				return val;
+				return c-'0';
 			}
 		}		
 		return 0;
@@ -137,7 +137,24 @@ class Dungeon : public Graph
 
 	void* XYToNode( int x, int y )
 	{
-		return (void*) ( y*MAPX + x );
+		return (void*)(intptr_t) ( y*MAPX + x );
+	}
+
+	float PathCost( const std::vector<void*>& p )
+	{
+		float cost = 0;
+		std::vector< StateCost > adjacent;
+		for( size_t i=1; i<p.size(); ++i ) {
+			adjacent.clear();
+			AdjacentCost( p[i-1], &adjacent );
+			for( const StateCost& sc : adjacent ) {
+				if ( sc.state == p[i] ) {
+					cost += sc.cost;
+					break;
+				}
+			}
+		}
+		return cost;
 	}
 		
 	
@@ -152,14 +169,15 @@ class Dungeon : public Graph
 		return (float) sqrt( (double)(dx*dx) + (double)(dy*dy) );
 	}
 
-	virtual void  AdjacentCost( void* node, MPVector< StateCost > *neighbors ) 
+	//					E  N  W   S     NE  NW  SW SE
+	const int dx[8] = { 1, 0, -1, 0,	1, -1, -1, 1 };
+	const int dy[8] = { 0, -1, 0, 1,	-1, -1, 1, 1 };
+	const float cost[8] = { 1.0f, 1.0f, 1.0f, 1.0f, 
+							1.41f, 1.41f, 1.41f, 1.41f };
+
+	virtual void  AdjacentCost( void* node, std::vector< StateCost > *neighbors ) 
 	{
 		int x, y;
-		//					E  N  W   S     NE  NW  SW SE
-		const int dx[8] = { 1, 0, -1, 0,	1, -1, -1, 1 };
-		const int dy[8] = { 0, -1, 0, 1,	-1, -1, 1, 1 };
-		const float cost[8] = { 1.0f, 1.0f, 1.0f, 1.0f, 
-								1.41f, 1.41f, 1.41f, 1.41f };
 
 		NodeToXY( node, &x, &y );
 
@@ -176,16 +194,96 @@ class Dungeon : public Graph
 		}
 	}
 
-	virtual void  PrintStateInfo( void* node ) 
+	// The terrain cost is paid on entering a cell, so the steps into 'node' all cost
+	// what entering it does.
+	virtual bool ReverseAdjacentCost( void* node, std::vector< StateCost > *neighbors ) 
 	{
 		int x, y;
 		NodeToXY( node, &x, &y );
-		printf( "(%2d,%2d)", x, y );
+		float pass = (float)Passable( x, y );
+		if ( pass == 0 ) {
+			return true;
+		}
+
+		for( int i=0; i<maxDir; ++i ) {
+			int nx = x + dx[i];
+			int ny = y + dy[i];
+
+			if ( Passable( nx, ny ) > 0 ) {
+				StateCost nodeCost = { XYToNode( nx, ny ), cost[i] * pass };
+				neighbors->push_back( nodeCost );
+			}
+		}
+		return true;
 	}
 
 };
 
 
+// The flow field benchmark: every test location heads for one goal, either with
+// a Solve() each or by following one flow field. The GridGraph copy of the map
+// ignores the terrain costs, but exercises the grid fast path.
+void FlowFieldTest( Dungeon* dungeon, const int* indexArray, int count )
+{
+	GridGraph grid( MAPX, MAPY, GridMoves::Eight, 1.0f, 1.41f );
+	for( int y=0; y<MAPY; ++y ) {
+		for( int x=0; x<MAPX; ++x ) {
+			grid.SetPassable( x, y, dungeon->Passable( x, y ) > 0 );
+		}
+	}
+	// Both without the path cache, so the individual solves are real searches and
+	// not cache hits on the paths to the one goal.
+	MicroPather dungeonPather( dungeon, MAPX*MAPY, 6, false );
+	MicroPather gridPather( &grid, MAPX*MAPY, 8, false );
+
+	Graph* graphs[2] = { dungeon, &grid };
+	MicroPather* pathers[2] = { &dungeonPather, &gridPather };
+	const char* names[2] = { "Dungeon ", "GridGraph" };
+
+	FlowField field;
+	std::vector<void*> path;
+
+	for( int g=0; g<2; ++g )
+	{
+		MicroPather* pather = pathers[g];
+		bool isGrid = graphs[g] == &grid;
+		const int goalIndex = indexArray[0];
+		void* goal = isGrid ? grid.State( goalIndex % MAPX, goalIndex / MAPX ) : dungeon->XYToNode( goalIndex % MAPX, goalIndex / MAPX );
+
+		pather->Reset();
+		TimePoint start = FastTime();
+		size_t steps = 0;
+		for( int i=1; i<count; ++i ) {
+			int index = indexArray[i];
+			void* state = isGrid ? grid.State( index % MAPX, index / MAPX ) : dungeon->XYToNode( index % MAPX, index / MAPX );
+			path = pather->Solve( state, goal );
+			steps += path.size();
+		}
+		int64_t solveTime = Nanoseconds( start, FastTime() );
+
+		start = FastTime();
+		pather->SolveFlowField( goal, &field );
+		size_t fieldSteps = 0;
+		for( int i=1; i<count; ++i ) {
+			int index = indexArray[i];
+			void* state = isGrid ? grid.State( index % MAPX, index / MAPX ) : dungeon->XYToNode( index % MAPX, index / MAPX );
+			void* next = 0;
+			if ( field.Next( state, &next ) == FLT_MAX ) {
+				continue;
+			}
+			for( ++fieldSteps; next; field.Next( next, &next ) ) {
+				++fieldSteps;
+			}
+		}
+		int64_t fieldTime = Nanoseconds( start, FastTime() );
+
+		printf( "Flow field, %s: %d solves = %7.2f  field = %7.2f  (steps %d / %d)\n",
+				names[g], count-1, double(solveTime) * 0.001, double(fieldTime) * 0.001,
+				(int)steps, (int)fieldSteps );
+	}
+}
+
+
 int main( int argc, const char* argv[] )
 {
 	Dungeon dungeon;
@@ -195,25 +293,15 @@ int main( int argc, const char* argv[] )
 	int		indexArray[ NUM_TEST ];	// a bunch of locations to go from-to
 	float	costArray[ NUM_TEST ];
 	int64_t timeArray[ NUM_TEST ];
-	int		resultArray[ NUM_TEST ];
+	bool	resultArray[ NUM_TEST ];
 
-	bool useBinaryHash = false;
-	bool useList = false;
 	bool debug = false;
 
 	#ifdef DEBUG
 	debug = true;
 	#endif
-	#ifdef USE_BINARY_HASH
-	useBinaryHash = true;
-	#endif
-	#ifdef USE_LIST
-	useList = true;
-	#endif 
 	
-	printf( "SpeedTest binaryHash=%s list=%s debug=%s\n",
-			useBinaryHash ? "true" : "false",
-			useList ? "true" : "false",
+	printf( "SpeedTest debug=%s\n",
 			debug ? "true" : "false" );
 					
 	// Set up the test locations, making sure they
@@ -253,7 +341,6 @@ int main( int argc, const char* argv[] )
 
 		for( int reset=0; reset<=1; ++reset )
 		{
-			TimePoint clockStart = FastTime();
 			for( int i=0; i<NUM_TEST; ++i ) 
 			{
 				if ( reset )
@@ -263,13 +350,13 @@ int main( int argc, const char* argv[] )
 				int endState = indexArray[ (i==(NUM_TEST-1)) ? 0 : i+1];
 
 				TimePoint start = FastTime();
-				resultArray[i] = dungeon.aStar->Solve( (void*)startState, (void*)endState, &dungeon.path, &costArray[i] );
+				dungeon.path = dungeon.aStar->Solve( (void*)(intptr_t)startState, (void*)(intptr_t)endState );
 				TimePoint end = FastTime();
 
 				timeArray[i] = Nanoseconds(start, end);
-				MPASSERT(timeArray[i]);
+				resultArray[i] = !dungeon.path.empty();
+				costArray[i] = dungeon.PathCost( dungeon.path );
 			}
-			TimePoint clockEnd = FastTime();
 
 			#ifndef PROFILING_RUN
 			// -------- Results ------------ //
@@ -282,7 +369,7 @@ int main( int argc, const char* argv[] )
 			for(int i=0; i<NUM_TEST; ++i )
 			{
 				int idx = 0;
-				if ( resultArray[i] == MicroPather::SOLVED ) {
+				if ( resultArray[i] ) {
 					if ( costArray[i] < shortPath ) {
 						idx = SHORT_PATH;
 					}
@@ -293,12 +380,12 @@ int main( int argc, const char* argv[] )
 						idx = LONG_PATH;
 					}
 				}
-				else if ( resultArray[i] == MicroPather::NO_SOLUTION ) {
+				else {
 					int startState = indexArray[i];
 					int endState = indexArray[ (i==(NUM_TEST-1)) ? 0 : i+1];
 					int startX, startY, endX, endY;
-					dungeon.NodeToXY( (void*)startState, &startX, &startY );
-					dungeon.NodeToXY( (void*)endState, &endX, &endY );
+					dungeon.NodeToXY( (void*)(intptr_t)startState, &startX, &startY );
+					dungeon.NodeToXY( (void*)(intptr_t)endState, &endX, &endY );
 
 					int distance = abs( startX - endX ) + abs( startY - endY );
 
@@ -334,6 +421,8 @@ int main( int argc, const char* argv[] )
 	}
 	printf( "Composite average = %7.2f\n", double(compositeScore) / 4 * 0.001);
 
+	FlowFieldTest( &dungeon, indexArray, NUM_TEST );
+
 	return 0;
 }
 